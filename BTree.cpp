@@ -1,301 +1,1365 @@
 #include "BTree.h"
+#include "Prefetch.h"
+#include "Key.h"
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <bit>
+#include <cmath>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
 using namespace std;
 
-BTreeNode::BTreeNode(int _t, bool _leaf) {
-    t = _t;
+template <class Key, class Value, int Order, class Compare>
+BTreeNode<Key, Value, Order, Compare>::BTreeNode(int _t, bool _leaf) : BTreeOrder<Order>(_t) {
     leaf = _leaf;
+    prev = nullptr;
+    next = nullptr;
+    count = 0;
 }
 
-int BTreeNode::findKey(const string &key) {
-    int idx = 0;
-    while (idx < (int)keys.size() && keys[idx] < key)
-        ++idx;
-    return idx;
+// Live values held by a leaf's posting lists, or by an internal node's
+// children.
+template <class Node>
+static size_t countRecords(const Node* node) {
+    size_t total = 0;
+    if (node->leaf) {
+        for (int i = 0; i < node->keyCount(); ++i)
+            total += node->live(i).size();
+    } else {
+        for (const Node* child : node->children)
+            total += child->count;
+    }
+    return total;
 }
 
-void BTreeNode::remove(const string &key) {
-    int idx = findKey(key);
+// Tracked fields over one posting list. Only Record values can be tracked;
+// any other tree never has fields to summarise.
+template <class Value>
+static vector<Aggregate> summarise(const vector<const NumericField*>& fields, span<const Value> postings) {
+    vector<Aggregate> out(fields.size());
+    if constexpr (is_same_v<Value, Record>) {
+        for (const Record& r : postings) {
+            for (size_t f = 0; f < fields.size(); ++f)
+                out[f].add(fields[f]->value(r));
+        }
+    }
+    return out;
+}
 
-    if (idx < (int)keys.size() && keys[idx] == key) {
-        if (leaf)
-            removeFromLeaf(idx);
-        else
-            removeFromNonLeaf(idx);
+template <class Value>
+static void addRecord(vector<Aggregate>& aggregates, const vector<const NumericField*>& fields, const Value& r) {
+    if constexpr (is_same_v<Value, Record>) {
+        for (size_t f = 0; f < fields.size(); ++f)
+            aggregates[f].add(fields[f]->value(r));
+    }
+}
+
+static void addAggregates(vector<Aggregate>& into, const vector<Aggregate>& part) {
+    for (size_t f = 0; f < into.size(); ++f)
+        into[f].add(part[f]);
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::refreshAggregates(size_t fields) {
+    if (fields == 0) return;
+    aggregates.assign(fields, Aggregate());
+    if (leaf) {
+        for (const vector<Aggregate>& posting : postingAggregates)
+            addAggregates(aggregates, posting);
     } else {
-        if (leaf) {
-            cout << "The key " << key << " is not present in the tree.\n";
-            return;
+        for (const BTreeNode* child : children)
+            addAggregates(aggregates, child->aggregates);
+    }
+}
+
+// Nodes with fewer than kPrefixSearchMin keys are scanned with plain suffix
+// compares: a handful of short suffixes fit in a cache line or two, and
+// touching the head array as well costs more than it saves. Larger nodes
+// count heads (SIMD when available), and from kBinarySearchMin keys on
+// use a branchless binary search over them instead.
+static constexpr int kPrefixSearchMin = 8;
+static constexpr int kBinarySearchMin = 32;
+
+static uint64_t keyPrefix(string_view key) {
+    unsigned char buf[8] = {};
+    memcpy(buf, key.data(), min<size_t>(sizeof(buf), key.size()));
+    uint64_t v = 0;
+    for (unsigned char b : buf)
+        v = (v << 8) | b;
+    return v;
+}
+
+// Number of p[0..n) that are < kp (orEqual: <= kp). p is sorted, so this is
+// the lower (upper) bound of kp.
+static int countPrefixes(const uint64_t* p, int n, uint64_t kp, bool orEqual) {
+    if (n >= kBinarySearchMin) {
+        const uint64_t* base = p;
+        int len = n;
+        while (len > 1) {
+            int half = len / 2;
+            bool right = orEqual ? base[half] <= kp : base[half] < kp;
+            base += right ? half : 0;
+            len -= half;
         }
+        return int(base - p) + (orEqual ? *base <= kp : *base < kp);
+    }
+
+    int i = 0, count = 0;
+#if defined(__SSE4_2__)
+    // SSE4.2 only has a signed 64-bit compare; flipping the sign bit of both
+    // sides turns it into an unsigned one.
+    const __m128i flip = _mm_set1_epi64x(INT64_MIN);
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi64x((long long)kp), flip);
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + i)), flip);
+        __m128i less = orEqual ? _mm_xor_si128(_mm_cmpgt_epi64(v, needle), _mm_set1_epi64x(-1))
+                               : _mm_cmpgt_epi64(needle, v);
+        count += popcount((unsigned)_mm_movemask_pd(_mm_castsi128_pd(less)));
+    }
+#endif
+    for (; i < n; ++i)
+        count += orEqual ? p[i] <= kp : p[i] < kp;
+    return count;
+}
+
+// Length of the longest common prefix of a and b.
+static size_t commonPrefix(string_view a, string_view b) {
+    size_t n = min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+// The bytes left and right share plus the first byte of right that differs
+// (left < right): keys of two states split at "Alas", not "Alaska_1978".
+string PrefixKeys::separator(string_view left, string_view right) {
+    return string(right.substr(0, commonPrefix(left, right) + 1));
+}
+
+string_view PrefixKeys::suffix(int i) const {
+    uint32_t begin = i == 0 ? prefixLength : suffixEnds[i - 1];
+    return string_view(keyBytes.data() + begin, suffixEnds[i] - begin);
+}
+
+string PrefixKeys::key(int i) const {
+    string out;
+    copyKey(i, out);
+    return out;
+}
+
+void PrefixKeys::copyKey(int i, string& out) const {
+    out.assign(prefix());
+    out.append(suffix(i));
+}
+
+int PrefixKeys::compareKey(int i, string_view key) const {
+    int c = prefix().compare(key.substr(0, prefixLength));
+    if (c != 0) return c;
+    return suffix(i).compare(key.substr(prefixLength));
+}
+
+bool PrefixKeys::keyEquals(int i, string_view key) const {
+    string_view rest = suffix(i);
+    return key.size() == prefixLength + rest.size() && key.starts_with(prefix()) &&
+           key.substr(prefixLength) == rest;
+}
+
+// First slot whose key is not less than key (upper: greater than key).
+// Every key in the node starts with its prefix, so a search key that differs
+// there falls before or after the whole node, and otherwise only the suffixes
+// are compared. The heads narrow the answer to the run of slots whose head
+// ties with the key's, and only that run is searched with suffix compares.
+static int slotSearch(const PrefixKeys* node, string_view key, bool upper) {
+    int n = node->keyCount();
+    if (n == 0) return 0;
+    int c = key.substr(0, node->prefixLength).compare(node->prefix());
+    if (c != 0)
+        return c < 0 ? 0 : n;
 
-        bool flag = ((idx == (int)keys.size()) ? true : false);
-        if ((int)children[idx]->keys.size() < t)
-            fill(idx);
+    string_view rest = key.substr(node->prefixLength);
+    auto before = [&](int i) {
+        string_view s = node->suffix(i);
+        return upper ? s <= rest : s < rest;
+    };
+    if (n < kPrefixSearchMin) {
+        int i = 0;
+        while (i < n && before(i))
+            ++i;
+        return i;
+    }
 
-        if (flag && idx > (int)keys.size())
-            children[idx - 1]->remove(key);
+    const uint64_t* p = node->heads.data();
+    uint64_t kp = keyPrefix(rest);
+    int lo = countPrefixes(p, n, kp, false);
+    if (lo == n || p[lo] != kp)
+        return lo;
+    int hi = countPrefixes(p, n, kp, true);
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (before(mid))
+            lo = mid + 1;
         else
-            children[idx]->remove(key);
+            hi = mid;
     }
+    return lo;
+}
+
+// Index of the first key that is not less than key.
+int PrefixKeys::findKey(string_view key) const {
+    return slotSearch(this, key, false);
 }
 
-void BTreeNode::removeFromLeaf(int idx) {
-    keys.erase(keys.begin() + idx);
-    values.erase(values.begin() + idx);
+// Index of the first key greater than key.
+int PrefixKeys::upperKey(string_view key) const {
+    return slotSearch(this, key, true);
 }
 
-void BTreeNode::removeFromNonLeaf(int idx) {
-    string k = keys[idx];
+// Cuts the prefix down to its first length bytes and puts the rest back in
+// front of every suffix.
+void PrefixKeys::shortenPrefix(size_t length) {
+    string_view moved = prefix().substr(length);
+    string rebuilt(keyBytes, 0, length);
+    rebuilt.reserve(keyBytes.size() + moved.size() * suffixEnds.size());
+    for (int i = 0; i < keyCount(); ++i) {
+        size_t begin = rebuilt.size();
+        rebuilt.append(moved);
+        rebuilt.append(suffix(i));
+        heads[i] = keyPrefix(string_view(rebuilt).substr(begin));
+    }
+    // Suffix i starts moved.size() earlier and grows by that much, and so
+    // does every suffix before it.
+    for (int i = 0; i < keyCount(); ++i)
+        suffixEnds[i] += (uint32_t)(moved.size() * i);
+    keyBytes.swap(rebuilt);
+    prefixLength = (uint32_t)length;
+}
 
-    if ((int)children[idx]->keys.size() >= t) {
-        string predKey = getPredecessor(idx);
-        Record predVal = children[idx]->values.back();
-        keys[idx] = predKey;
-        values[idx] = predVal;
-        children[idx]->remove(predKey);
-    } else if ((int)children[idx + 1]->keys.size() >= t) {
-        string succKey = getSuccessor(idx);
-        Record succVal = children[idx + 1]->values.front();
-        keys[idx] = succKey;
-        values[idx] = succVal;
-        children[idx + 1]->remove(succKey);
-    } else {
-        merge(idx);
-        children[idx]->remove(k);
+// A key that keeps the shared prefix only stores its suffix; one that
+// diverges earlier shortens the prefix of the whole node first. The first key
+// of an empty node becomes its prefix.
+void PrefixKeys::insertKey(int i, string_view key) {
+    if (suffixEnds.empty()) {
+        keyBytes.assign(key);
+        prefixLength = (uint32_t)key.size();
+        suffixEnds.assign(1, prefixLength);
+        heads.assign(1, 0);
+        return;
     }
+    size_t shared = commonPrefix(prefix(), key);
+    if (shared < prefixLength)
+        shortenPrefix(shared);
+
+    string_view rest = key.substr(prefixLength);
+    uint32_t at = i == 0 ? prefixLength : suffixEnds[i - 1];
+    keyBytes.insert(at, rest.data(), rest.size());
+    suffixEnds.insert(suffixEnds.begin() + i, at);
+    for (int j = i; j < keyCount(); ++j)
+        suffixEnds[j] += (uint32_t)rest.size();
+    heads.insert(heads.begin() + i, keyPrefix(rest));
 }
 
-string BTreeNode::getPredecessor(int idx) {
-    BTreeNode* cur = children[idx];
-    while (!cur->leaf)
-        cur = cur->children.back();
-    return cur->keys.back();
+// Removing a key never invalidates the shared prefix; it may only leave it
+// shorter than it could be until the next compactPrefix.
+void PrefixKeys::eraseKey(int i) {
+    uint32_t begin = i == 0 ? prefixLength : suffixEnds[i - 1];
+    uint32_t length = suffixEnds[i] - begin;
+    keyBytes.erase(begin, length);
+    suffixEnds.erase(suffixEnds.begin() + i);
+    for (int j = i; j < keyCount(); ++j)
+        suffixEnds[j] -= length;
+    heads.erase(heads.begin() + i);
+}
+
+void PrefixKeys::setKey(int i, string_view key) {
+    eraseKey(i);
+    insertKey(i, key);
+}
+
+// An empty node takes everything the range shares as its prefix and then
+// only the rest of each suffix, so no key has to shorten the prefix.
+void PrefixKeys::appendKeys(const PrefixKeys& from, int first, int last) {
+    if (first >= last) return;
+    if (suffixEnds.empty()) {
+        size_t shared = commonPrefix(from.suffix(first), from.suffix(last - 1));
+        from.copyKey(first, keyBytes);
+        prefixLength = from.prefixLength + (uint32_t)shared;
+        keyBytes.resize(prefixLength);
+        heads.clear();
+        for (int i = first; i < last; ++i) {
+            string_view rest = from.suffix(i).substr(shared);
+            keyBytes.append(rest);
+            suffixEnds.push_back((uint32_t)keyBytes.size());
+            heads.push_back(keyPrefix(rest));
+        }
+        return;
+    }
+    string key;
+    for (int i = first; i < last; ++i) {
+        from.copyKey(i, key);
+        insertKey(keyCount(), key);
+    }
+}
+
+void PrefixKeys::truncateKeys(int n) {
+    keyBytes.resize(n == 0 ? prefixLength : suffixEnds[n - 1]);
+    suffixEnds.resize(n);
+    heads.resize(n);
+}
+
+// Keys are sorted, so the first and last suffix decide how much they all
+// share. The first suffix already follows the prefix, so those bytes join it
+// where they are, and the later suffixes move down over their copies.
+void PrefixKeys::compactPrefix() {
+    int n = keyCount();
+    if (n == 0) return;
+    uint32_t shared = (uint32_t)commonPrefix(suffix(0), suffix(n - 1));
+    if (shared == 0) return;
+    uint32_t begin = prefixLength;
+    prefixLength += shared;
+    uint32_t out = prefixLength;
+    for (int i = 0; i < n; ++i) {
+        uint32_t length = suffixEnds[i] - begin - shared;
+        memmove(keyBytes.data() + out, keyBytes.data() + begin + shared, length);
+        begin = suffixEnds[i];
+        heads[i] = keyPrefix(string_view(keyBytes.data() + out, length));
+        out += length;
+        suffixEnds[i] = out;
+    }
+    keyBytes.resize(out);
+}
+
+// Surviving suffixes slide down over the erased ones in key order, so the
+// shared prefix and the heads stay valid.
+void PrefixKeys::eraseKeys(const vector<bool>& erased) {
+    int kept = 0;
+    uint32_t begin = prefixLength;
+    uint32_t out = prefixLength;
+    for (int i = 0; i < keyCount(); ++i) {
+        uint32_t end = suffixEnds[i];
+        if (!erased[i]) {
+            memmove(keyBytes.data() + out, keyBytes.data() + begin, end - begin);
+            out += end - begin;
+            suffixEnds[kept] = out;
+            heads[kept] = heads[i];
+            ++kept;
+        }
+        begin = end;
+    }
+    keyBytes.resize(out);
+    suffixEnds.resize(kept);
+    heads.resize(kept);
+}
+
+void PrefixKeys::prefetchKeys() const {
+    prefetchRead(keyBytes.data());
+    prefetchRead(heads.data());
+    prefetchRead(suffixEnds.data());
+}
+
+// Packed integer keys in their natural order reuse the branch-free count the
+// string heads use; any other key takes a binary search with Compare.
+template <class Key, class Compare, size_t Capacity>
+int SortedKeys<Key, Compare, Capacity>::findKey(const Key& key) const {
+    if constexpr (is_same_v<Key, uint64_t> && is_same_v<Compare, less<uint64_t>>)
+        return countPrefixes(keys.data(), keyCount(), key, false);
+    else
+        return int(lower_bound(keys.begin(), keys.end(), key, Compare()) - keys.begin());
+}
+
+template <class Key, class Compare, size_t Capacity>
+int SortedKeys<Key, Compare, Capacity>::upperKey(const Key& key) const {
+    if constexpr (is_same_v<Key, uint64_t> && is_same_v<Compare, less<uint64_t>>)
+        return countPrefixes(keys.data(), keyCount(), key, true);
+    else
+        return int(upper_bound(keys.begin(), keys.end(), key, Compare()) - keys.begin());
+}
+
+template <class Key, class Compare, size_t Capacity>
+void SortedKeys<Key, Compare, Capacity>::eraseKeys(const vector<bool>& erased) {
+    int kept = 0;
+    for (int i = 0; i < keyCount(); ++i) {
+        if (!erased[i])
+            keys[kept++] = keys[i];
+    }
+    keys.resize(kept);
 }
 
-string BTreeNode::getSuccessor(int idx) {
-    BTreeNode* cur = children[idx + 1];
+template <class Key, class Compare, size_t Capacity>
+void SortedKeys<Key, Compare, Capacity>::prefetchKeys() const {
+    prefetchRead(keys.data());
+}
+
+// Keys whose values are all tombstoned go in one eraseKeys pass, and the
+// surviving posting lists move down with their keys.
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::purgeDead() {
+    if (dead.empty()) return;
+    vector<bool> erased(keyCount());
+    int kept = 0;
+    for (int i = 0; i < keyCount(); ++i) {
+        vector<Value>& postings = values[i];
+        postings.erase(postings.begin(), postings.begin() + dead[i]);
+        erased[i] = postings.empty();
+        if (erased[i]) continue;
+        if (kept != i) {
+            values[kept] = std::move(postings);
+            if (!postingAggregates.empty())
+                postingAggregates[kept] = std::move(postingAggregates[i]);
+        }
+        ++kept;
+    }
+    eraseKeys(erased);
+    values.resize(kept);
+    if (!postingAggregates.empty())
+        postingAggregates.resize(kept);
+    dead.clear();
+    compactPrefix();
+}
+
+// Leaf and slot of the first key >= key. A key equal to a separator lives in
+// the subtree right of it, so the descent takes upperKey. When key itself is
+// absent and falls after every key of its leaf, the answer is the head of
+// the next leaf.
+template <class Key, class Value, int Order, class Compare>
+BTreeNode<Key, Value, Order, Compare>* BTreeNode<Key, Value, Order, Compare>::findLeaf(KeyArg key, int& slot) {
+    BTreeNode* cur = this;
     while (!cur->leaf)
-        cur = cur->children.front();
-    return cur->keys.front();
+        cur = cur->children[cur->upperKey(key)];
+    slot = cur->findKey(key);
+    if (slot == cur->keyCount() && cur->next) {
+        cur = cur->next;
+        slot = 0;
+    }
+    return cur;
 }
 
-void BTreeNode::fill(int idx) {
-    if (idx != 0 && (int)children[idx - 1]->keys.size() >= t)
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::fill(int idx) {
+    if (idx != 0 && children[idx - 1]->keyCount() >= t)
         borrowFromPrev(idx);
-    else if (idx != (int)keys.size() && (int)children[idx + 1]->keys.size() >= t)
+    else if (idx != keyCount() && children[idx + 1]->keyCount() >= t)
         borrowFromNext(idx);
     else {
-        if (idx != (int)keys.size())
+        if (idx != keyCount())
             merge(idx);
         else
             merge(idx - 1);
     }
 }
 
-void BTreeNode::borrowFromPrev(int idx) {
+// Leaves move one entry across and recompute the separator between them;
+// internal nodes rotate a key through the parent.
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::borrowFromPrev(int idx) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx - 1];
+    int last = sibling->keyCount() - 1;
 
-    child->keys.insert(child->keys.begin(), keys[idx - 1]);
-    child->values.insert(child->values.begin(), values[idx - 1]);
-
-    if (!child->leaf)
+    if (child->leaf) {
+        size_t moved = sibling->values.back().size();
+        child->count += moved;
+        sibling->count -= moved;
+        child->insertKey(0, sibling->key(last));
+        child->values.insert(child->values.begin(), std::move(sibling->values.back()));
+        sibling->eraseKey(last);
+        sibling->values.pop_back();
+        if (!sibling->postingAggregates.empty()) {
+            child->postingAggregates.insert(child->postingAggregates.begin(),
+                                            std::move(sibling->postingAggregates.back()));
+            sibling->postingAggregates.pop_back();
+        }
+        setKey(idx - 1, Keys::separator(sibling->key(last - 1), child->key(0)));
+    } else {
+        child->count += sibling->children.back()->count;
+        sibling->count -= sibling->children.back()->count;
+        child->insertKey(0, key(idx - 1));
         child->children.insert(child->children.begin(), sibling->children.back());
-
-    keys[idx - 1] = sibling->keys.back();
-    values[idx - 1] = sibling->values.back();
-
-    sibling->keys.pop_back();
-    sibling->values.pop_back();
-    if (!sibling->leaf)
+        setKey(idx - 1, sibling->key(last));
+        sibling->eraseKey(last);
         sibling->children.pop_back();
+    }
+    child->refreshAggregates(child->aggregates.size());
+    sibling->refreshAggregates(sibling->aggregates.size());
 }
 
-void BTreeNode::borrowFromNext(int idx) {
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::borrowFromNext(int idx) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx + 1];
 
-    child->keys.push_back(keys[idx]);
-    child->values.push_back(values[idx]);
-
-    if (!child->leaf)
+    if (child->leaf) {
+        size_t moved = sibling->values.front().size();
+        child->count += moved;
+        sibling->count -= moved;
+        child->insertKey(child->keyCount(), sibling->key(0));
+        child->values.push_back(std::move(sibling->values.front()));
+        sibling->eraseKey(0);
+        sibling->values.erase(sibling->values.begin());
+        if (!sibling->postingAggregates.empty()) {
+            child->postingAggregates.push_back(std::move(sibling->postingAggregates.front()));
+            sibling->postingAggregates.erase(sibling->postingAggregates.begin());
+        }
+        setKey(idx, Keys::separator(child->key(child->keyCount() - 1), sibling->key(0)));
+    } else {
+        child->count += sibling->children.front()->count;
+        sibling->count -= sibling->children.front()->count;
+        child->insertKey(child->keyCount(), key(idx));
         child->children.push_back(sibling->children.front());
-
-    keys[idx] = sibling->keys.front();
-    values[idx] = sibling->values.front();
-
-    sibling->keys.erase(sibling->keys.begin());
-    sibling->values.erase(sibling->values.begin());
-    if (!sibling->leaf)
+        setKey(idx, sibling->key(0));
+        sibling->eraseKey(0);
         sibling->children.erase(sibling->children.begin());
+    }
+    child->refreshAggregates(child->aggregates.size());
+    sibling->refreshAggregates(sibling->aggregates.size());
 }
 
-void BTreeNode::merge(int idx) {
+// Folds children[idx + 1] into children[idx]. Leaves simply concatenate and
+// unlink the sibling; internal nodes pull the separator down between them.
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::merge(int idx) {
     BTreeNode* child = children[idx];
     BTreeNode* sibling = children[idx + 1];
 
-    child->keys.push_back(keys[idx]);
-    child->values.push_back(values[idx]);
-
-    for (int i = 0; i < (int)sibling->keys.size(); ++i) {
-        child->keys.push_back(sibling->keys[i]);
-        child->values.push_back(sibling->values[i]);
-    }
-    if (!child->leaf) {
-        for (auto c : sibling->children)
-            child->children.push_back(c);
+    if (child->leaf) {
+        child->appendKeys(*sibling, 0, sibling->keyCount());
+        move(sibling->values.begin(), sibling->values.end(), back_inserter(child->values));
+        move(sibling->postingAggregates.begin(), sibling->postingAggregates.end(),
+             back_inserter(child->postingAggregates));
+        child->next = sibling->next;
+        if (sibling->next)
+            sibling->next->prev = child;
+    } else {
+        child->insertKey(child->keyCount(), key(idx));
+        child->appendKeys(*sibling, 0, sibling->keyCount());
+        child->children.insert(child->children.end(), sibling->children.begin(), sibling->children.end());
     }
 
-    keys.erase(keys.begin() + idx);
-    values.erase(values.begin() + idx);
+    child->count += sibling->count;
+    child->refreshAggregates(child->aggregates.size());
+    child->compactPrefix();
+    eraseKey(idx);
     children.erase(children.begin() + idx + 1);
 
     delete sibling;
 }
 
-BTree::BTree(int _t) {
+template <class Key, class Value, int Order, class Compare>
+BasicBTree<Key, Value, Order, Compare>::BasicBTree(int _t) requires (Order == dynamicOrder) : BTreeOrder<Order>(_t) {
     root = nullptr;
-    t = _t;
 }
 
-void BTree::remove(const string &key) {
-    if (!root) return;
-    root->remove(key);
-    if (root->keys.empty()) {
-        BTreeNode* tmp = root;
+template <class Key, class Value, int Order, class Compare>
+BasicBTree<Key, Value, Order, Compare>::BasicBTree() requires (Order != dynamicOrder) : BTreeOrder<Order>(Order) {
+    root = nullptr;
+}
+
+// Frees every node with an explicit work list instead of recursing.
+template <class Node>
+static void destroyTree(Node* root) {
+    vector<Node*> pending;
+    if (root) pending.push_back(root);
+    while (!pending.empty()) {
+        Node* node = pending.back();
+        pending.pop_back();
+        if (!node->leaf)
+            pending.insert(pending.end(), node->children.begin(), node->children.end());
+        delete node;
+    }
+}
+
+template <class Key, class Value, int Order, class Compare>
+BasicBTree<Key, Value, Order, Compare>::~BasicBTree() {
+    destroyTree(root);
+}
+
+// Internal nodes on the way from the root to a leaf: nodes[d] is the node at
+// depth d and slots[d] the child taken from it. Every non-root internal node
+// has at least two children, so a path this long would need 2^63 keys; the
+// fixed size keeps insert and remove at constant stack usage for any order.
+template <class Node>
+struct BTreePath {
+    static constexpr int kMaxDepth = 64;
+    Node* nodes[kMaxDepth];
+    int slots[kMaxDepth];
+    int depth = 0;
+
+    void push(Node* node, int slot) {
+        nodes[depth] = node;
+        slots[depth] = slot;
+        ++depth;
+    }
+};
+
+// Descends to the only leaf that can hold key, recording the path.
+template <class Node>
+static Node* descend(Node* node, typename Node::KeyArg key, BTreePath<Node>& path) {
+    while (!node->leaf) {
+        int i = node->upperKey(key);
+        path.push(node, i);
+        node = node->children[i];
+    }
+    return node;
+}
+
+// Removes the oldest record stored under key, or all of them, and returns how
+// many went. A key whose posting list empties leaves its leaf, and the
+// underflow is repaired bottom-up along the recorded path. In lazy mode the
+// records are only tombstoned and the tree keeps its shape.
+template <class Key, class Value, int Order, class Compare>
+size_t BasicBTree<Key, Value, Order, Compare>::removeRecords(KeyArg key, bool all) {
+    thaw();
+    if (!root) return 0;
+
+    BTreePath<Node> path;
+    Node* node = descend(root, key, path);
+    int i = node->findKey(key);
+    if (i >= node->keyCount() || !node->keyEquals(i, key))
+        return 0;
+
+    vector<Value>& postings = node->values[i];
+    size_t live = node->live(i).size();
+    if (live == 0) return 0;
+    size_t removed = all ? live : 1;
+    node->count -= removed;
+    for (int d = 0; d < path.depth; ++d)
+        path.nodes[d]->count -= removed;
+    bool keyGone = !lazyDeletes && removed == postings.size();
+    if (lazyDeletes) {
+        if (node->dead.empty())
+            node->dead.assign(node->keyCount(), 0);
+        node->dead[i] += (uint32_t)removed;
+        tombstones += removed;
+    } else if (keyGone) {
+        node->eraseKey(i);
+        node->values.erase(node->values.begin() + i);
+        if (!tracked.empty())
+            node->postingAggregates.erase(node->postingAggregates.begin() + i);
+    } else {
+        postings.erase(postings.begin());
+    }
+    // Min and max cannot be taken back out, so the key's posting and every
+    // node on the path are recombined from the level below.
+    if (!tracked.empty()) {
+        if (!keyGone)
+            node->postingAggregates[i] = summarise(tracked, node->live(i));
+        node->refreshAggregates(tracked.size());
+        for (int d = path.depth - 1; d >= 0; --d)
+            path.nodes[d]->refreshAggregates(tracked.size());
+    }
+    if (lazyDeletes && tombstones > size())
+        compact();
+    if (!keyGone)
+        return removed;
+    while (path.depth > 0 && node->keyCount() < t - 1) {
+        --path.depth;
+        Node* parent = path.nodes[path.depth];
+        parent->fill(path.slots[path.depth]);
+        node = parent;
+    }
+
+    if (root->keyCount() == 0) {
+        Node* tmp = root;
         if (root->leaf)
             root = nullptr;
         else
             root = root->children[0];
         delete tmp;
     }
+    return removed;
 }
 
-void BTreeNode::insertNonFull(const string& key, const Record& value) {
-    int i = (int)keys.size() - 1;
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::remove(KeyArg key) {
+    if (removeRecords(key, false) == 0)
+        cout << "The key " << key << " is not present in the tree.\n";
+}
 
-    if (leaf) {
-        while (i >= 0 && keys[i] > key)
-            i--;
-        keys.insert(keys.begin() + i + 1, key);
-        values.insert(values.begin() + i + 1, value);
-    } else {
-        while (i >= 0 && keys[i] > key)
-            i--;
-        i++;
-        if ((int)children[i]->keys.size() == 2 * t - 1) {
-            splitChild(i, children[i]);
-            if (keys[i] < key)
-                i++;
-        }
-        children[i]->insertNonFull(key, value);
-    }
+template <class Key, class Value, int Order, class Compare>
+size_t BasicBTree<Key, Value, Order, Compare>::removeAll(KeyArg key) {
+    return removeRecords(key, true);
+}
+
+// Assembles state + "_" + year in buf, or returns an empty view if it does
+// not fit; callers then fall back to makeKey.
+static string_view compositeKey(char (&buf)[64], string_view state, int year) {
+    YearDigits digits(year);
+    size_t len = state.size() + 1 + digits.len;
+    if (len > sizeof(buf))
+        return {};
+    memcpy(buf, state.data(), state.size());
+    buf[state.size()] = '_';
+    memcpy(buf + state.size() + 1, digits.buf, digits.len);
+    return string_view(buf, len);
 }
 
-void BTreeNode::splitChild(int i, BTreeNode* y) {
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::remove(string_view state, int year) requires kStringKeys {
+    char buf[64];
+    string_view key = compositeKey(buf, state, year);
+    if (key.empty())
+        remove(makeKey(state, year));
+    else
+        remove(key);
+}
+
+// Splits children[i] = y, which holds 2t - 1 or 2t keys, around its middle.
+// A leaf moves its upper half to the new right leaf and passes up the
+// shortest separator between the two halves; an internal node moves its
+// middle separator up instead. Each half then keeps whatever longer prefix
+// its own keys share.
+template <class Key, class Value, int Order, class Compare>
+void BTreeNode<Key, Value, Order, Compare>::splitChild(int i, BTreeNode* y) {
     BTreeNode* z = new BTreeNode(y->t, y->leaf);
+    Key separator;
+    int n = y->keyCount();
+    int mid = n / 2;
 
-    for (int j = 0; j < t - 1; j++) {
-        z->keys.push_back(y->keys[j + t]);
-        z->values.push_back(y->values[j + t]);
-    }
+    if (y->leaf) {
+        z->appendKeys(*y, mid, n);
+        z->values.assign(make_move_iterator(y->values.begin() + mid), make_move_iterator(y->values.end()));
+        y->values.resize(mid);
+        if (!y->postingAggregates.empty()) {
+            z->postingAggregates.assign(make_move_iterator(y->postingAggregates.begin() + mid),
+                                        make_move_iterator(y->postingAggregates.end()));
+            y->postingAggregates.resize(mid);
+        }
+        if (!y->dead.empty()) {
+            z->dead.assign(y->dead.begin() + mid, y->dead.end());
+            y->dead.resize(mid);
+        }
+        separator = Keys::separator(y->key(mid - 1), z->key(0));
 
-    if (!y->leaf) {
-        for (int j = 0; j < t; j++)
-            z->children.push_back(y->children[j + t]);
+        z->prev = y;
+        z->next = y->next;
+        if (y->next)
+            y->next->prev = z;
+        y->next = z;
+    } else {
+        separator = y->key(mid);
+        z->appendKeys(*y, mid + 1, n);
+        z->children.assign(y->children.begin() + mid + 1, y->children.end());
+        y->children.resize(mid + 1);
     }
-
-    y->keys.resize(t - 1);
-    y->values.resize(t - 1);
-    if (!y->leaf)
-        y->children.resize(t);
+    y->truncateKeys(mid);
+    y->compactPrefix();
+    z->count = countRecords(z);
+    y->count -= z->count;
+    y->refreshAggregates(y->aggregates.size());
+    z->refreshAggregates(y->aggregates.size());
 
     children.insert(children.begin() + i + 1, z);
-    keys.insert(keys.begin() + i, y->keys[t - 1]);
-    values.insert(values.begin() + i, y->values[t - 1]);
+    insertKey(i, separator);
 }
 
-void BTree::insert(const string& key, const Record& value) {
+// A key already present only gets the record appended to its posting list,
+// so search/remove keep seeing the oldest record first. A new key may leave
+// its leaf briefly holding 2t keys; overflowing nodes are then split
+// bottom-up along the recorded path.
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::insert(KeyArg key, const Value& value) {
+    thaw();
     if (root == nullptr) {
-        root = new BTreeNode(t, true);
-        root->keys.push_back(key);
-        root->values.push_back(value);
-    } else {
-        if ((int)root->keys.size() == 2 * t - 1) {
-            BTreeNode* s = new BTreeNode(t, false);
+        root = new Node(t, true);
+        root->insertKey(0, key);
+        root->values.push_back({value});
+        root->count = 1;
+        if (!tracked.empty()) {
+            root->postingAggregates.push_back(summarise(tracked, root->live(0)));
+            root->aggregates = root->postingAggregates[0];
+        }
+        return;
+    }
+
+    BTreePath<Node> path;
+    Node* node = descend(root, key, path);
+    ++node->count;
+    for (int d = 0; d < path.depth; ++d)
+        ++path.nodes[d]->count;
+    if (!tracked.empty()) {
+        addRecord(node->aggregates, tracked, value);
+        for (int d = 0; d < path.depth; ++d)
+            addRecord(path.nodes[d]->aggregates, tracked, value);
+    }
+    int i = node->findKey(key);
+    if (i < node->keyCount() && node->keyEquals(i, key)) {
+        node->values[i].push_back(value);
+        if (!tracked.empty())
+            addRecord(node->postingAggregates[i], tracked, value);
+        return;
+    }
+    node->insertKey(i, key);
+    node->values.insert(node->values.begin() + i, vector<Value>{value});
+    if (!node->dead.empty())
+        node->dead.insert(node->dead.begin() + i, 0);
+    if (!tracked.empty())
+        node->postingAggregates.insert(node->postingAggregates.begin() + i, summarise(tracked, node->live(i)));
+
+    while (node->keyCount() > 2 * t - 1) {
+        if (path.depth == 0) {
+            Node* s = new Node(t, false);
+            s->count = root->count;
+            s->aggregates = root->aggregates;
             s->children.push_back(root);
             s->splitChild(0, root);
-            int i = 0;
-            if (s->keys[0] < key)
-                i++;
-            s->children[i]->insertNonFull(key, value);
             root = s;
-        } else {
-            root->insertNonFull(key, value);
+            break;
+        }
+        --path.depth;
+        Node* parent = path.nodes[path.depth];
+        parent->splitChild(path.slots[path.depth], node);
+        node = parent;
+    }
+}
+
+template <class Key, class Value, int Order, class Compare>
+Value* BasicBTree<Key, Value, Order, Compare>::search(KeyArg key) {
+    if constexpr (kFreezable) {
+        if (frozen) return frozen->search(key);
+    }
+    if (root == nullptr) return nullptr;
+    int i;
+    Node* node = root->findLeaf(key, i);
+    if (i < node->keyCount() && node->keyEquals(i, key) && !node->live(i).empty())
+        return &node->values[i][node->firstLive(i)];
+    return nullptr;
+}
+
+template <class Key, class Value, int Order, class Compare>
+span<Value> BasicBTree<Key, Value, Order, Compare>::searchAll(KeyArg key) {
+    if constexpr (kFreezable) {
+        if (frozen) return frozen->searchAll(key);
+    }
+    if (root == nullptr) return {};
+    int i;
+    Node* node = root->findLeaf(key, i);
+    if (i < node->keyCount() && node->keyEquals(i, key))
+        return span<Value>(node->values[i]).subspan(node->firstLive(i));
+    return {};
+}
+
+// Node searches compare the node's prefix and then normalized suffix heads,
+// so the key is assembled once in a stack buffer rather than compared part
+// by part.
+template <class Key, class Value, int Order, class Compare>
+Value* BasicBTree<Key, Value, Order, Compare>::search(string_view state, int year) requires kStringKeys {
+    char buf[64];
+    string_view key = compositeKey(buf, state, year);
+    if (key.empty())
+        return search(makeKey(state, year));
+    return search(key);
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::searchBatch(span<const KeyView> keys, span<Value*> out) {
+    if constexpr (kFreezable) {
+        if (frozen) {
+            for (size_t i = 0; i < keys.size(); ++i)
+                out[i] = frozen->search(keys[i]);
+            return;
+        }
+    }
+
+    constexpr size_t kGroup = 16;
+    Node* node[kGroup];
+
+    for (size_t base = 0; base < keys.size(); base += kGroup) {
+        size_t n = min(kGroup, keys.size() - base);
+        for (size_t i = 0; i < n; ++i) {
+            out[base + i] = nullptr;
+            node[i] = root;
+        }
+        if (root == nullptr) continue;
+
+        // All leaves sit at the same depth, so the whole group reaches the
+        // leaf level in the same round.
+        while (!node[0]->leaf) {
+            for (size_t i = 0; i < n; ++i) {
+                node[i] = node[i]->children[node[i]->upperKey(keys[base + i])];
+                prefetchRead(node[i]);
+            }
+            // The second pass runs once the node headers requested by the
+            // first have had time to arrive, and fetches the keys they point
+            // to.
+            for (size_t i = 0; i < n; ++i)
+                node[i]->prefetchKeys();
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            const KeyView& key = keys[base + i];
+            Node* leaf = node[i];
+            int j = leaf->findKey(key);
+            if (j < leaf->keyCount() && leaf->keyEquals(j, key) && !leaf->live(j).empty())
+                out[base + i] = &leaf->values[j][leaf->firstLive(j)];
         }
     }
 }
 
-BTreeNode* BTreeNode::search(const string& key) {
+template <class Key, class Value, int Order, class Compare>
+BTreeNode<Key, Value, Order, Compare>* BasicBTree<Key, Value, Order, Compare>::firstLeaf() const {
+    if (root == nullptr) return nullptr;
+    Node* cur = root;
+    while (!cur->leaf)
+        cur = cur->children.front();
+    return cur;
+}
+
+template <class Key, class Value, int Order, class Compare>
+int BasicBTree<Key, Value, Order, Compare>::height() const {
+    int levels = 0;
+    for (const Node* node = root; node != nullptr; ++levels)
+        node = node->leaf ? nullptr : node->children.front();
+    return levels;
+}
+
+template <class Key, class Value, int Order, class Compare>
+size_t BasicBTree<Key, Value, Order, Compare>::size() const {
+    return root ? root->count : 0;
+}
+
+// Every child left of the one the descent takes holds only keys below key,
+// as does every slot left of key's place in the leaf.
+template <class Key, class Value, int Order, class Compare>
+size_t BasicBTree<Key, Value, Order, Compare>::rank(KeyArg key) const {
+    size_t below = 0;
+    const Node* node = root;
+    if (!node) return 0;
+    while (!node->leaf) {
+        int i = node->upperKey(key);
+        for (int j = 0; j < i; ++j)
+            below += node->children[j]->count;
+        node = node->children[i];
+    }
+    int slot = node->findKey(key);
+    for (int j = 0; j < slot; ++j)
+        below += node->live(j).size();
+    return below;
+}
+
+template <class Key, class Value, int Order, class Compare>
+Value* BasicBTree<Key, Value, Order, Compare>::select(size_t k, Key* key) const {
+    if (k >= size()) return nullptr;
+    Node* node = root;
+    while (!node->leaf) {
+        int i = 0;
+        while (k >= node->children[i]->count)
+            k -= node->children[i++]->count;
+        node = node->children[i];
+    }
     int i = 0;
-    while (i < (int)keys.size() && key > keys[i])
-        i++;
-    if (i < (int)keys.size() && keys[i] == key)
-        return this;
-    if (leaf)
-        return nullptr;
-    return children[i]->search(key);
+    while (k >= node->live(i).size())
+        k -= node->live(i++).size();
+    if (key) node->copyKey(i, *key);
+    return &node->values[i][node->firstLive(i) + k];
 }
 
-Record* BTree::search(const string& key) {
+template <class Key, class Value, int Order, class Compare>
+Value* BasicBTree<Key, Value, Order, Compare>::quantile(double q, Key* key) const {
+    size_t n = size();
+    if (n == 0) return nullptr;
+    double position = ceil(clamp(q, 0.0, 1.0) * (double)n);
+    return select(position < 1 ? 0 : min(n - 1, (size_t)position - 1), key);
+}
+
+template <class Key, class Value, int Order, class Compare>
+BTreeNode<Key, Value, Order, Compare>* BasicBTree<Key, Value, Order, Compare>::lastLeaf() const {
     if (root == nullptr) return nullptr;
-    BTreeNode* node = root->search(key);
-    if (node == nullptr) return nullptr;
-    for (size_t i = 0; i < node->keys.size(); i++) {
-        if (node->keys[i] == key)
-            return &node->values[i];
+    Node* cur = root;
+    while (!cur->leaf)
+        cur = cur->children.back();
+    return cur;
+}
+
+template <class Key, class Value, int Order, class Compare>
+size_t BasicBTree<Key, Value, Order, Compare>::rangeScan(KeyArg lo, KeyArg hi,
+                                                 const function<void(const Key&, const Value&)>& visit) const {
+    if constexpr (kFreezable) {
+        if (frozen) return frozen->rangeScan(lo, hi, visit);
     }
-    return nullptr;
+    if (root == nullptr || !Node::Keys::keyLess(lo, hi)) return 0;
+
+    int i;
+    Node* node = root->findLeaf(lo, i);
+    size_t visited = 0;
+    Key key;
+    for (; node != nullptr; node = node->next, i = 0) {
+        for (; i < node->keyCount(); i++) {
+            if (node->compareKey(i, hi) >= 0)
+                return visited;
+            span<const Value> live = node->live(i);
+            if (live.empty()) continue;
+            node->copyKey(i, key);
+            for (const Value& r : live)
+                visit(key, r);
+            visited += live.size();
+        }
+    }
+    return visited;
+}
+
+// Smallest string greater than every string that starts with prefix, or
+// empty if there is none (prefix empty or all 0xFF bytes).
+static string prefixSuccessor(string_view prefix) {
+    string hi(prefix);
+    while (!hi.empty() && (unsigned char)hi.back() == 0xFF)
+        hi.pop_back();
+    if (!hi.empty())
+        hi.back() = (char)((unsigned char)hi.back() + 1);
+    return hi;
+}
+
+template <class Key, class Value, int Order, class Compare>
+vector<pair<string, Value>> BasicBTree<Key, Value, Order, Compare>::searchPrefix(const string& prefix) requires kStringKeys {
+    vector<pair<string, Value>> results;
+    auto collect = [&](const string& key, const Value& value) { results.push_back({key, value}); };
+
+    string hi = prefixSuccessor(prefix);
+    if (!hi.empty()) {
+        rangeScan(prefix, hi, collect);
+    } else {
+        forEach([&](const string& key, const Value& value) {
+            if (key.starts_with(prefix))
+                collect(key, value);
+        });
+    }
+    return results;
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::setOrder(int newT) requires (Order == dynamicOrder) {
+    if (newT == t) return;
+    thaw();
+    BasicBTree rebuilt(newT);
+    forEach([&](const Key& key, const Value& value) { rebuilt.insert(key, value); });
+    swap(root, rebuilt.root);
+    swap(t, rebuilt.t);
+    tombstones = 0;
+    if constexpr (is_same_v<Value, Record>) {
+        if (!tracked.empty())
+            trackAggregates(tracked);
+    }
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::trackAggregates(const vector<const NumericField*>& fields) requires is_same_v<Value, Record> {
+    tracked = fields;
+    if (!root) return;
+    // Parents come before their children in level order, so walking it
+    // backwards computes every child before its parent.
+    vector<Node*> order{root};
+    for (size_t k = 0; k < order.size(); ++k) {
+        if (!order[k]->leaf)
+            order.insert(order.end(), order[k]->children.begin(), order[k]->children.end());
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Node* node = *it;
+        node->aggregates.clear();
+        node->postingAggregates.clear();
+        if (tracked.empty()) continue;
+        if (node->leaf) {
+            for (int i = 0; i < node->keyCount(); ++i)
+                node->postingAggregates.push_back(summarise(tracked, node->live(i)));
+        }
+        node->refreshAggregates(tracked.size());
+    }
+}
+
+template <class Key, class Value, int Order, class Compare>
+vector<Aggregate> BasicBTree<Key, Value, Order, Compare>::aggregates() const {
+    return root ? root->aggregates : vector<Aggregate>(tracked.size());
+}
+
+// Descends while lo and hi fall into the same child. Below the node where
+// they part, every child strictly between the two is inside the range, and
+// so is every subtree right of lo's path and left of hi's path; only the two
+// edge leaves are summed slot by slot.
+template <class Key, class Value, int Order, class Compare>
+vector<Aggregate> BasicBTree<Key, Value, Order, Compare>::rangeAggregate(KeyArg lo, KeyArg hi) const {
+    vector<Aggregate> out(tracked.size());
+    if (!root || tracked.empty() || !Node::Keys::keyLess(lo, hi)) return out;
+
+    const Node* node = root;
+    int from = 0, to = 0;
+    while (!node->leaf) {
+        from = node->upperKey(lo);
+        to = node->upperKey(hi);
+        if (from != to) break;
+        node = node->children[from];
+    }
+    if (node->leaf) {
+        for (int i = node->findKey(lo), end = node->findKey(hi); i < end; ++i)
+            addAggregates(out, node->postingAggregates[i]);
+        return out;
+    }
+    for (int k = from + 1; k < to; ++k)
+        addAggregates(out, node->children[k]->aggregates);
+
+    const Node* left = node->children[from];
+    while (!left->leaf) {
+        int i = left->upperKey(lo);
+        for (int k = i + 1; k < (int)left->children.size(); ++k)
+            addAggregates(out, left->children[k]->aggregates);
+        left = left->children[i];
+    }
+    for (int i = left->findKey(lo); i < left->keyCount(); ++i)
+        addAggregates(out, left->postingAggregates[i]);
+
+    const Node* right = node->children[to];
+    while (!right->leaf) {
+        int i = right->upperKey(hi);
+        for (int k = 0; k < i; ++k)
+            addAggregates(out, right->children[k]->aggregates);
+        right = right->children[i];
+    }
+    for (int i = 0, end = right->findKey(hi); i < end; ++i)
+        addAggregates(out, right->postingAggregates[i]);
+    return out;
+}
+
+// Moves to the first live record of the next key, skipping keys whose
+// records are all tombstoned.
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::advance() {
+    do {
+        if (++slot >= leaf->keyCount()) {
+            leaf = leaf->next;
+            slot = 0;
+            if (!leaf) return;
+        }
+    } while (leaf->live(slot).empty());
+    posting = leaf->firstLive(slot);
 }
 
-void BTreeNode::collectPrefix(const string& prefix, vector<pair<string, Record>>& results) {
-    for (size_t i = 0; i < keys.size(); i++) {
-        if (keys[i].substr(0, prefix.length()) == prefix) {
-            results.push_back({keys[i], values[i]});
+// Moves to the newest record of the previous key with a live record.
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::retreat() {
+    do {
+        if (slot == 0) {
+            leaf = leaf->prev;
+            if (!leaf) return;
+            slot = leaf->keyCount();
         }
+        --slot;
+    } while (leaf->live(slot).empty());
+    posting = leaf->values[slot].size() - 1;
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::seek(KeyArg key) {
+    leaf = nullptr;
+    const Node* node = tree->root;
+    if (!node) return;
+    while (!node->leaf)
+        node = node->children[node->upperKey(key)];
+    leaf = node;
+    slot = node->findKey(key) - 1;
+    advance();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::seekBefore(KeyArg key) {
+    seek(key);
+    if (valid())
+        prev();
+    else
+        seekLast();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::seekFirst() {
+    leaf = tree->firstLeaf();
+    if (!leaf) return;
+    slot = -1;
+    advance();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::seekLast() {
+    leaf = tree->lastLeaf();
+    if (!leaf) return;
+    slot = leaf->keyCount();
+    retreat();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::next() {
+    if (++posting < leaf->values[slot].size()) return;
+    advance();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::Cursor::prev() {
+    if (posting > leaf->firstLive(slot)) {
+        --posting;
+        return;
+    }
+    retreat();
+}
+
+template <class Key, class Value, int Order, class Compare>
+const Key& BasicBTree<Key, Value, Order, Compare>::Cursor::key() const {
+    if (keyLeaf != leaf || keySlot != slot) {
+        leaf->copyKey(slot, keyBuffer);
+        keyLeaf = leaf;
+        keySlot = slot;
     }
-    
+    return keyBuffer;
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::traverse() {
+    forEach([](const Key& key, const Value&) { cout << " " << key; });
+}
 
-    if (!leaf) {
-        for (size_t i = 0; i < children.size(); i++) {
-            children[i]->collectPrefix(prefix, results);
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::forEach(const function<void(const Key&, const Value&)>& visit) const {
+    Key key;
+    for (Node* node = firstLeaf(); node != nullptr; node = node->next) {
+        for (int i = 0; i < node->keyCount(); i++) {
+            span<const Value> live = node->live(i);
+            if (live.empty()) continue;
+            node->copyKey(i, key);
+            for (const Value& r : live)
+                visit(key, r);
         }
     }
 }
 
-vector<pair<string, Record>> BTree::searchPrefix(const string& prefix) {
-    vector<pair<string, Record>> results;
-    if (root == nullptr) return results;
-    root->collectPrefix(prefix, results);
-    return results;
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::setLazyDelete(bool lazy) {
+    if (!lazy)
+        compact();
+    lazyDeletes = lazy;
 }
 
-void BTreeNode::traverse() {
-    int i;
-    for (i = 0; i < (int)keys.size(); i++) {
-        if (!leaf) {
-            children[i]->traverse();
+// Repairs underfull children bottom-up without recursion: internal nodes
+// are listed level by level and repaired deepest first, so a parent sees
+// its children at their final sizes. A fill only merges or reshapes the
+// children of the node being repaired, which were all visited before it.
+// Returns whether anything changed. A merge or borrow at one level can move
+// an underfull grandchild next to new siblings, or leave a node with a
+// single child it cannot repair, so compact repeats the pass until it
+// changes nothing.
+template <class Node>
+static bool repairUnderflow(Node* root) {
+    vector<Node*> order;
+    if (!root->leaf) order.push_back(root);
+    for (size_t k = 0; k < order.size(); ++k) {
+        for (Node* child : order[k]->children)
+            if (!child->leaf) order.push_back(child);
+    }
+    bool changed = false;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Node* node = *it;
+        for (int idx = 0; idx < (int)node->children.size(); ++idx) {
+            while (node->children.size() > 1 && node->children[idx]->keyCount() < node->t - 1) {
+                node->fill(idx);
+                idx = min(idx, (int)node->children.size() - 1);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// Purges every tombstone in one pass over the leaves, then repairs the
+// nodes that pass left underfull. Counts and aggregates already exclude
+// dead records, so only structure changes here.
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::compact() {
+    if (tombstones == 0) return;
+    thaw();
+    for (Node* node = firstLeaf(); node != nullptr; node = node->next)
+        node->purgeDead();
+    tombstones = 0;
+
+    bool changed = true;
+    while (root && changed) {
+        changed = repairUnderflow(root);
+        while (root && root->keyCount() == 0) {
+            Node* tmp = root;
+            root = root->leaf ? nullptr : root->children[0];
+            delete tmp;
+            changed = true;
         }
-        cout << " " << keys[i];
     }
-    if (!leaf) {
-        children[i]->traverse();
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::freeze() requires kFreezable {
+    compact();
+    vector<pair<string, vector<Record>*>> entries;
+    for (Node* node = firstLeaf(); node != nullptr; node = node->next) {
+        for (int i = 0; i < node->keyCount(); i++)
+            entries.push_back({node->key(i), &node->values[i]});
     }
+    frozen = make_unique<FrozenBTree>();
+    frozen->build(std::move(entries));
+}
+
+template <class Key, class Value, int Order, class Compare>
+void BasicBTree<Key, Value, Order, Compare>::thaw() {
+    frozen.reset();
 }
 
-void BTree::traverse() {
-    if (root != nullptr) {
-        root->traverse();
+template <class Key, class Value, int Order, class Compare>
+bool BasicBTree<Key, Value, Order, Compare>::isFrozen() const {
+    return frozen != nullptr;
+}
+
+// Bytes a string spends outside the object itself (none while the short
+// string buffer holds it).
+static size_t heapBytes(size_t length) {
+    return length > 15 ? length + 1 : 0;
+}
+
+template <class Key, class Value, int Order, class Compare>
+BTreeLayout BasicBTree<Key, Value, Order, Compare>::layout() const requires kStringKeys {
+    BTreeLayout out;
+    vector<pair<const Node*, size_t>> pending;
+    if (root) pending.push_back({root, 1});
+    while (!pending.empty()) {
+        auto [node, depth] = pending.back();
+        pending.pop_back();
+        out.height = max(out.height, depth);
+        int n = node->keyCount();
+        if (node != root && n < t - 1)
+            ++out.underfullNodes;
+        out.keyBytes += sizeof(string) + heapBytes(node->keyBytes.size()) + sizeof(uint32_t) +
+                        2 * sizeof(vector<uint64_t>) + n * (sizeof(uint32_t) + sizeof(uint64_t));
+        out.unpackedKeyBytes += 2 * sizeof(vector<uint64_t>) + sizeof(size_t);
+        for (int i = 0; i < n; ++i) {
+            size_t length = node->prefixLength + node->suffix(i).size();
+            out.unpackedKeyBytes += sizeof(string) + heapBytes(length) + sizeof(uint64_t);
+        }
+        if (node->leaf) {
+            ++out.leaves;
+            out.keys += n;
+            continue;
+        }
+        ++out.innerNodes;
+        out.separators += n;
+        for (int i = 0; i < n; ++i) {
+            // A separator stands for the first key of the subtree right of it.
+            const Node* first = node->children[i + 1];
+            while (!first->leaf)
+                first = first->children.front();
+            out.separatorBytes += node->suffix(i).size();
+            out.separatorLength += node->prefixLength + node->suffix(i).size();
+            out.fullSeparatorLength += first->keyCount() ? first->prefixLength + first->suffix(0).size() : 0;
+        }
+        for (const Node* child : node->children)
+            pending.push_back({child, depth + 1});
     }
+    return out;
 }
+
+// The combinations the program uses. Members a combination does not satisfy
+// (composite keys, freeze and layout need string keys) are left out.
+template class BasicBTree<string, Record>;
+template class BasicBTree<string, Record, 16>;
+template class BasicBTree<uint64_t, Record, 16>;
+template class BasicBTree<uint64_t, Record, 64>;
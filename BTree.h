@@ -7,46 +7,415 @@
 #define BTREE_H
 
 #include "Record.h"
+#include "FrozenBTree.h"
+#include "NumericField.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 using namespace std;
 
-class BTreeNode {
+// Count, sum, min and max of one numeric field over a set of records.
+struct Aggregate {
+    size_t count = 0;
+    double sum = 0;
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+
+    void add(double value) {
+        ++count;
+        sum += value;
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+    void add(const Aggregate& other) {
+        count += other.count;
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+    }
+    double mean() const { return count ? sum / count : 0; }
+};
+
+// Minimum degree the constructor takes at run time, for trees whose Order
+// template argument does not fix it.
+inline constexpr int dynamicOrder = 0;
+
+// Minimum degree t of a tree and of its nodes. A fixed Order makes t a
+// constant, so the bounds derived from it (2t - 1 keys before a split, t - 1
+// before a borrow) fold into the node code; dynamicOrder keeps it a field.
+template <int Order>
+struct BTreeOrder {
+    static_assert(Order >= 2, "a B-tree needs a minimum degree of at least 2");
+    static constexpr int t = Order;
+    explicit BTreeOrder(int) {}
+};
+
+template <>
+struct BTreeOrder<dynamicOrder> {
+    int t;
+    explicit BTreeOrder(int _t) : t(_t) {}
+};
+
+// Keys of one node of a tree with string keys in byte order, prefix-truncated:
+// the bytes every key in the node starts with are kept once, and only the
+// rest of each key (its suffix) is stored. keyBytes holds that prefix
+// followed by every suffix in key order, so a node's key bytes are one
+// allocation; suffix i ends at suffixEnds[i].
+// heads[i] packs the first 8 bytes of suffix i big-endian, so comparing heads
+// as integers orders keys the same way as comparing the strings. Slot
+// searches compare the search key against the prefix once, then the heads,
+// and fall back to suffix compares only for keys whose head ties with the
+// search key's. Separators are suffix-truncated as well: a leaf split passes
+// up the shortest string that divides the two leaves rather than a whole key.
+// Keys are changed only through insertKey/eraseKey/setKey/appendKeys/
+// truncateKeys/eraseKeys; a key passed in must not point into the node.
+class PrefixKeys {
+public:
+    using KeyArg = string_view;
+
+    string keyBytes;               // prefix, then each key without it
+    uint32_t prefixLength = 0;
+    vector<uint32_t> suffixEnds;   // suffix i is [suffixEnds[i - 1], suffixEnds[i])
+    vector<uint64_t> heads;        // 8 bytes of suffix i
+
+    int keyCount() const { return (int)suffixEnds.size(); }
+    // Shared by every key in the node.
+    string_view prefix() const { return string_view(keyBytes.data(), prefixLength); }
+    string_view suffix(int i) const;
+    string key(int i) const;
+    // Assigns key(i) to out, reusing its buffer.
+    void copyKey(int i, string& out) const;
+    // Three-way comparison of key(i) with key.
+    int compareKey(int i, string_view key) const;
+    bool keyEquals(int i, string_view key) const;
+    int findKey(string_view key) const;
+    int upperKey(string_view key) const;
+    void insertKey(int i, string_view key);
+    void eraseKey(int i);
+    void setKey(int i, string_view key);
+    // Appends keys [first, last) of from after the node's own keys.
+    void appendKeys(const PrefixKeys& from, int first, int last);
+    // Keeps only the first n keys.
+    void truncateKeys(int n);
+    // Drops every key i with erased[i] set, in one pass.
+    void eraseKeys(const vector<bool>& erased);
+    // Moves bytes every suffix shares into the prefix.
+    void compactPrefix();
+    // Starts fetching the key bytes, heads and offsets a search will read.
+    void prefetchKeys() const;
+    // Shortest string s with left < s <= right, the separator passed up
+    // between two leaves.
+    static string separator(string_view left, string_view right);
+    static bool keyLess(string_view a, string_view b) { return a < b; }
+
+private:
+    void shortenPrefix(size_t length);
+};
+
+// The few vector operations SortedKeys needs over a fixed array, so the keys
+// of a node with a compile-time order are stored inside the node.
+template <class T, size_t N>
+class InlineVector {
+public:
+    size_t size() const { return n; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T* begin() { return items; }
+    T* end() { return items + n; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + n; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    void push_back(const T& value) { items[n++] = value; }
+    void insert(T* at, const T& value) {
+        move_backward(at, end(), end() + 1);
+        *at = value;
+        ++n;
+    }
+    void erase(T* at) {
+        move(at + 1, end(), at);
+        --n;
+    }
+    // Only ever shrinks.
+    void resize(size_t m) { n = m; }
+
+private:
+    T items[N];
+    size_t n = 0;
+};
+
+// Keys of one node as a sorted array ordered by Compare, for every tree other
+// than one with string keys in byte order. Capacity 0 keeps them in a vector;
+// a tree with a compile-time order passes 2t, the most keys a node holds
+// before it is split, and the keys live inside the node. Separators are
+// whole keys. As with PrefixKeys, a key passed in must not point into the
+// node.
+template <class Key, class Compare, size_t Capacity>
+class SortedKeys {
+public:
+    using KeyArg = const Key&;
+
+    conditional_t<Capacity == 0, vector<Key>, InlineVector<Key, Capacity>> keys;
+
+    int keyCount() const { return (int)keys.size(); }
+    const Key& key(int i) const { return keys[i]; }
+    void copyKey(int i, Key& out) const { out = keys[i]; }
+    int compareKey(int i, const Key& key) const {
+        return Compare()(keys[i], key) ? -1 : Compare()(key, keys[i]) ? 1 : 0;
+    }
+    bool keyEquals(int i, const Key& key) const { return compareKey(i, key) == 0; }
+    int findKey(const Key& key) const;
+    int upperKey(const Key& key) const;
+    void insertKey(int i, const Key& key) { keys.insert(keys.begin() + i, key); }
+    void eraseKey(int i) { keys.erase(keys.begin() + i); }
+    void setKey(int i, const Key& key) { keys[i] = key; }
+    void appendKeys(const SortedKeys& from, int first, int last) {
+        for (int i = first; i < last; ++i)
+            keys.push_back(from.keys[i]);
+    }
+    void truncateKeys(int n) { keys.resize(n); }
+    void eraseKeys(const vector<bool>& erased);
+    void compactPrefix() {}
+    void prefetchKeys() const;
+    static const Key& separator(const Key&, const Key& right) { return right; }
+    static bool keyLess(const Key& a, const Key& b) { return Compare()(a, b); }
+};
+
+// String keys in byte order are stored prefix-truncated; any other key type
+// or ordering is a plain sorted array.
+template <class Key, int Order, class Compare>
+using NodeKeys = conditional_t<is_same_v<Key, string> && is_same_v<Compare, less<string>>, PrefixKeys,
+                               SortedKeys<Key, Compare, Order == dynamicOrder ? 0 : 2 * Order>>;
+
+// B+tree node. Leaves hold every key once, with the values stored under it,
+// and are chained to their neighbours; internal nodes hold only separator
+// keys and child pointers. Separator i satisfies
+// children[i] keys < key(i) <= children[i + 1] keys. The keys themselves are
+// kept by the NodeKeys base.
+//
+// count is the number of values (not keys) in the node's subtree. Inserts
+// and removals adjust it along their path; splits, merges and borrows move
+// it with the keys and children they move, so it stays exact and rank/select
+// descend in O(t log n).
+//
+// When the tree tracks aggregate fields, aggregates[f] summarises field f
+// over the subtree and a leaf also keeps postingAggregates[i][f] over the
+// records of key(i). Inserts add the record along their path; removals and
+// every node a split, merge or borrow changes recombine from the level below,
+// so a range aggregate reads whole subtrees without touching their records.
+//
+// In lazy-delete mode a removal only tombstones values: dead[i] counts the
+// oldest values of values[i] that are gone (removals always take the oldest
+// live one). count and the aggregates cover live values only, and readers
+// start each posting list at firstLive(i). BasicBTree::compact purges them.
+// Nothing borrows or merges while tombstones exist, so only inserts and
+// splits keep dead in step with values.
+template <class Key, class Value, int Order, class Compare>
+class BTreeNode : public NodeKeys<Key, Order, Compare>, public BTreeOrder<Order> {
 public:
+    using Keys = NodeKeys<Key, Order, Compare>;
+    using KeyArg = typename Keys::KeyArg;
+    using Keys::keyCount;
+    using Keys::key;
+    using Keys::insertKey;
+    using Keys::eraseKey;
+    using Keys::setKey;
+    using Keys::eraseKeys;
+    using Keys::compactPrefix;
+    using BTreeOrder<Order>::t;
+
     bool leaf;
-    vector<string> keys;
-    vector<Record> values;
-    vector<BTreeNode*> children;
-    int t;
+    vector<vector<Value>> values; // leaf only: key(i)'s values, oldest first
+    vector<BTreeNode*> children;  // internal only, keyCount() + 1 children
+    BTreeNode* prev;              // leaf only: neighbouring leaves in key order
+    BTreeNode* next;
+    size_t count;                 // values in this subtree
+    vector<Aggregate> aggregates; // tracked fields over this subtree
+    vector<vector<Aggregate>> postingAggregates; // leaf only: tracked fields over values[i]
+    vector<uint32_t> dead;        // leaf only: tombstoned values of values[i]; empty when none
 
     BTreeNode(int _t, bool _leaf);
-    void insertNonFull(const string& key, const Record& value);
+    // Index of the oldest live value of values[i].
+    size_t firstLive(int i) const { return dead.empty() ? 0 : dead[i]; }
+    span<const Value> live(int i) const { return span<const Value>(values[i]).subspan(firstLive(i)); }
     void splitChild(int i, BTreeNode* y);
-    BTreeNode* search(const string& key);
-    void traverse();
-    void remove(const string& key);
-    int findKey(const string& key);
-    void removeFromLeaf(int idx);
-    void removeFromNonLeaf(int idx);
-    string getPredecessor(int idx);
-    string getSuccessor(int idx);
+    BTreeNode* findLeaf(KeyArg key, int& slot);
+    // Leaf only: drops tombstoned values, and keys left without any, in one
+    // pass.
+    void purgeDead();
     void fill(int idx);
     void borrowFromPrev(int idx);
     void borrowFromNext(int idx);
     void merge(int idx);
-    void collectPrefix(const string& prefix, vector<pair<string, Record>>& results);
+    // Recombines aggregates from postingAggregates or the children.
+    void refreshAggregates(size_t fields);
 };
 
-class BTree {
+// Shape of a BTree and the memory its nodes spend on keys (BTree::layout).
+struct BTreeLayout {
+    size_t height = 0;
+    size_t leaves = 0;
+    size_t innerNodes = 0;
+    size_t keys = 0;             // distinct leaf keys
+    size_t separators = 0;
+    size_t keyBytes = 0;         // key bytes, offsets and heads
+    size_t unpackedKeyBytes = 0; // the same keys held as one string each plus an 8-byte head
+    size_t separatorBytes = 0;   // suffix bytes stored for separators
+    size_t separatorLength = 0;  // total length of the separators
+    size_t fullSeparatorLength = 0; // total length of the keys they stand for
+    size_t underfullNodes = 0;   // nodes other than the root with fewer than t - 1 keys
+};
+
+// B+tree over keys of type Key ordered by Compare, holding any number of
+// values per key. Order fixes the minimum degree at compile time, or is
+// dynamicOrder to take it from the constructor. The member definitions live
+// in BTree.cpp, which explicitly instantiates the combinations the program
+// uses; add a line there for a new one.
+//
+// String keys in byte order (kStringKeys) also have the composite
+// "State_Year" lookups, prefix search and the layout report, and with Record
+// values freeze; aggregates need Record values.
+template <class Key, class Value, int Order = dynamicOrder, class Compare = less<Key>>
+class BasicBTree : public BTreeOrder<Order> {
 public:
-    BTreeNode* root;
-    int t;
-    BTree(int _t);
-    void insert(const string& key, const Record& value);
-    Record* search(const string& key);
+    using Node = BTreeNode<Key, Value, Order, Compare>;
+    using KeyArg = typename Node::KeyArg;
+    // Element type of the keys searchBatch takes.
+    using KeyView = remove_cvref_t<KeyArg>;
+    static constexpr bool kStringKeys = is_same_v<typename Node::Keys, PrefixKeys>;
+    static constexpr bool kFreezable = kStringKeys && is_same_v<Value, Record>;
+    using BTreeOrder<Order>::t;
+
+    // Position on one value of the leaf chain: a key slot of a leaf and a
+    // value in that key's posting list. seek is one descent; next and prev
+    // follow the leaf links, so each step is O(1) and nothing is copied.
+    // Duplicates are visited oldest first going forward. Any insert or remove
+    // invalidates the cursor.
+    class Cursor {
+    public:
+        explicit Cursor(const BasicBTree& tree) : tree(&tree) {}
+        // First value whose key is not less than key.
+        void seek(KeyArg key);
+        // Last value whose key is less than key: seekBefore(successor of a
+        // prefix) starts a reverse walk over that prefix.
+        void seekBefore(KeyArg key);
+        void seekFirst();
+        void seekLast();
+        bool valid() const { return leaf != nullptr; }
+        void next();
+        void prev();
+        // Valid until the cursor moves to another key.
+        const Key& key() const;
+        const Value& record() const { return leaf->values[slot][posting]; }
+
+    private:
+        void advance();
+        void retreat();
+
+        const BasicBTree* tree;
+        const Node* leaf = nullptr;
+        int slot = 0;
+        size_t posting = 0;
+        mutable Key keyBuffer;        // key(), assembled from prefix and suffix on demand
+        mutable const Node* keyLeaf = nullptr;
+        mutable int keySlot = -1;
+    };
+
+    Node* root;
+    BasicBTree(int _t) requires (Order == dynamicOrder);
+    BasicBTree() requires (Order != dynamicOrder);
+    ~BasicBTree();
+    BasicBTree(const BasicBTree&) = delete;
+    BasicBTree& operator=(const BasicBTree&) = delete;
+    void insert(KeyArg key, const Value& value);
+    // Oldest value stored under key.
+    Value* search(KeyArg key);
+    // Every value stored under key, oldest first, from one descent. Valid
+    // until the next insert or remove.
+    span<Value> searchAll(KeyArg key);
+    // Composite lookup: the "State_Year" key is assembled in a stack buffer,
+    // so the caller never builds the string.
+    Value* search(string_view state, int year) requires kStringKeys;
+    // Descends a group of keys one level at a time, prefetching every next
+    // child before comparing against any of them. out[i] receives the match
+    // for keys[i] or nullptr; out must be at least as long as keys.
+    void searchBatch(span<const KeyView> keys, span<Value*> out);
     void traverse();
-    void remove(const string& key);
-    vector<pair<string, Record>> searchPrefix(const string& prefix);
+    Cursor cursor() const { return Cursor(*this); }
+    // Calls visit(key, value) for every value in ascending key order.
+    void forEach(const function<void(const Key&, const Value&)>& visit) const;
+    // Removes the oldest value stored under key.
+    void remove(KeyArg key);
+    void remove(string_view state, int year) requires kStringKeys;
+    // With lazy deletes on, removals only tombstone values and never
+    // rebalance; lookups, scans and counts skip the dead values. compact()
+    // drops them all in one sweep and repairs underfull nodes; it also runs
+    // once tombstones outnumber live values, before freeze(), and when lazy
+    // deletes are switched off.
+    void setLazyDelete(bool lazy);
+    bool lazyDelete() const { return lazyDeletes; }
+    size_t tombstoneCount() const { return tombstones; }
+    void compact();
+    // Removes key with all its values; returns how many values went.
+    size_t removeAll(KeyArg key);
+    // Calls visit(key, value) for every value with lo <= key < hi, in
+    // ascending order: one descent to lo, then a leaf walk that stops at the
+    // first key >= hi. Returns the number of values visited.
+    size_t rangeScan(KeyArg lo, KeyArg hi, const function<void(const Key&, const Value&)>& visit) const;
+    // rangeScan over [prefix, successor of prefix).
+    vector<pair<string, Value>> searchPrefix(const string& prefix) requires kStringKeys;
+    Node* firstLeaf() const;
+    Node* lastLeaf() const;
+    // Levels from the root to the leaves; 0 for an empty tree.
+    int height() const;
+    // Number of values, counting every value of a duplicate key.
+    size_t size() const;
+    // Number of values whose key is less than key.
+    size_t rank(KeyArg key) const;
+    // The value at 0-based position k in key order (duplicates oldest
+    // first), or nullptr if k >= size(). key receives its key.
+    Value* select(size_t k, Key* key = nullptr) const;
+    // The value at quantile q in [0, 1] by nearest rank: q = 0.5 is the
+    // (lower) median. nullptr on an empty tree.
+    Value* quantile(double q, Key* key = nullptr) const;
+    // Rebuilds the tree with minimum degree newT, keeping every entry and the
+    // insertion order of duplicates.
+    void setOrder(int newT) requires (Order == dynamicOrder);
+    // Maintains subtree aggregates of fields from now on, computing them for
+    // the records already stored. An empty list stops tracking.
+    void trackAggregates(const vector<const NumericField*>& fields) requires is_same_v<Value, Record>;
+    const vector<const NumericField*>& aggregateFields() const { return tracked; }
+    // Aggregates of every tracked field over the whole tree, in O(1).
+    vector<Aggregate> aggregates() const;
+    // Aggregates of every tracked field over the records with lo <= key < hi,
+    // combined from O(t log n) node and posting summaries.
+    vector<Aggregate> rangeAggregate(KeyArg lo, KeyArg hi) const;
+    // Builds a FrozenBTree over the current entries. search, searchBatch,
+    // rangeScan and searchPrefix use it until the next insert or remove,
+    // which drops it (thaw) and falls back to the node search.
+    void freeze() requires kFreezable;
+    void thaw();
+    bool isFrozen() const;
+    BTreeLayout layout() const requires kStringKeys;
+
+private:
+    unique_ptr<FrozenBTree> frozen;
+    vector<const NumericField*> tracked;
+    bool lazyDeletes = false;
+    size_t tombstones = 0;
+
+    size_t removeRecords(KeyArg key, bool all);
 };
 
+// The application's tree: "State_Year" string keys, Record values and an
+// order chosen at run time.
+using BTree = BasicBTree<string, Record>;
+
 #endif
@@ -0,0 +1,156 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "BufferPool.h"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace {
+
+// Positioned read/write of one whole page. Windows has no pread/pwrite, so
+// it seeks first; the pool is single-threaded, so that is not a race.
+#ifdef _WIN32
+bool readAt(int fd, char *buf, size_t n, uint64_t offset) {
+    return _lseeki64(fd, (long long)offset, SEEK_SET) >= 0 && _read(fd, buf, (unsigned)n) == (int)n;
+}
+bool writeAt(int fd, const char *buf, size_t n, uint64_t offset) {
+    return _lseeki64(fd, (long long)offset, SEEK_SET) >= 0 && _write(fd, buf, (unsigned)n) == (int)n;
+}
+uint64_t fileSize(int fd) { return (uint64_t)_lseeki64(fd, 0, SEEK_END); }
+int openFile(const string &path, bool truncate) {
+    return _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), 0644);
+}
+void closeFile(int fd) { _close(fd); }
+#else
+bool readAt(int fd, char *buf, size_t n, uint64_t offset) {
+    return pread(fd, buf, n, (off_t)offset) == (ssize_t)n;
+}
+bool writeAt(int fd, const char *buf, size_t n, uint64_t offset) {
+    return pwrite(fd, buf, n, (off_t)offset) == (ssize_t)n;
+}
+uint64_t fileSize(int fd) { return (uint64_t)lseek(fd, 0, SEEK_END); }
+int openFile(const string &path, bool truncate) {
+    return ::open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+}
+void closeFile(int fd) { ::close(fd); }
+#endif
+
+}
+
+BufferPool::BufferPool(size_t pageSize, size_t frameCount)
+    : frameSize(pageSize), memory(new char[pageSize * frameCount]), frames(frameCount) {}
+
+BufferPool::~BufferPool() {
+    if (fd < 0) return;
+    flush();
+    closeFile(fd);
+}
+
+bool BufferPool::open(const string &path, bool truncate) {
+    if (fd >= 0) {
+        flush();
+        closeFile(fd);
+    }
+    frames.assign(frames.size(), Frame());
+    resident.clear();
+    fd = openFile(path, truncate);
+    if (fd < 0) {
+        cerr << "Cannot open page file " << path << "\n";
+        return false;
+    }
+    pages = (uint32_t)(fileSize(fd) / frameSize);
+    return true;
+}
+
+bool BufferPool::writeBack(size_t frame) {
+    Frame &f = frames[frame];
+    if (!f.dirty) return true;
+    if (!writeAt(fd, data(frame), frameSize, (uint64_t)f.pageId * frameSize)) {
+        cerr << "Write of page " << f.pageId << " failed\n";
+        return false;
+    }
+    f.dirty = false;
+    ++counters.writes;
+    return true;
+}
+
+size_t BufferPool::victim() {
+    // Two full sweeps clear every reference bit, so a third finding nothing
+    // means every frame is pinned.
+    for (size_t step = 0; step < 3 * frames.size(); ++step) {
+        size_t frame = hand;
+        hand = (hand + 1) % frames.size();
+        Frame &f = frames[frame];
+        if (!f.used) return frame;
+        if (f.pins > 0) continue;
+        if (f.referenced) {
+            f.referenced = false;
+            continue;
+        }
+        if (!writeBack(frame)) return frames.size();
+        resident.erase(f.pageId);
+        f.used = false;
+        ++counters.evictions;
+        return frame;
+    }
+    cerr << "Buffer pool exhausted: all " << frames.size() << " frames are pinned\n";
+    return frames.size();
+}
+
+char *BufferPool::pin(uint32_t pageId) {
+    auto it = resident.find(pageId);
+    if (it != resident.end()) {
+        Frame &f = frames[it->second];
+        ++f.pins;
+        f.referenced = true;
+        ++counters.hits;
+        return data(it->second);
+    }
+    ++counters.misses;
+    size_t frame = victim();
+    if (frame == frames.size()) return nullptr;
+    if (!readAt(fd, data(frame), frameSize, (uint64_t)pageId * frameSize)) {
+        cerr << "Read of page " << pageId << " failed\n";
+        return nullptr;
+    }
+    ++counters.reads;
+    frames[frame] = {pageId, 1, true, false, true};
+    resident[pageId] = frame;
+    return data(frame);
+}
+
+char *BufferPool::allocate(uint32_t &pageId) {
+    size_t frame = victim();
+    if (frame == frames.size()) return nullptr;
+    pageId = pages++;
+    memset(data(frame), 0, frameSize);
+    // Dirty from the start, so the page reaches the file before any read.
+    frames[frame] = {pageId, 1, true, true, true};
+    resident[pageId] = frame;
+    return data(frame);
+}
+
+void BufferPool::unpin(uint32_t pageId, bool dirty) {
+    auto it = resident.find(pageId);
+    if (it == resident.end()) return;
+    Frame &f = frames[it->second];
+    if (f.pins > 0) --f.pins;
+    f.dirty |= dirty;
+}
+
+bool BufferPool::flush() {
+    bool ok = true;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].used)
+            ok &= writeBack(i);
+    }
+    return ok;
+}
@@ -0,0 +1,77 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Fixed set of in-memory frames caching pages of one file. A page is pinned
+// while in use and cannot be evicted until every pin is released; dirty
+// pages are written back when evicted or on flush. Eviction uses CLOCK: a
+// hand sweeps the frames, giving each recently used page one more pass
+// before taking the first unpinned frame whose reference bit is clear.
+class BufferPool {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t reads = 0;
+        uint64_t writes = 0;
+        uint64_t evictions = 0;
+    };
+
+    BufferPool(size_t pageSize, size_t frameCount);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Opens (creating if needed) the backing file; truncate discards it.
+    bool open(const string &path, bool truncate);
+    bool isOpen() const { return fd >= 0; }
+    // Returns the pinned page, or nullptr on an I/O error or when every
+    // frame is pinned.
+    char *pin(uint32_t pageId);
+    // Appends a zeroed page to the file and returns it pinned and dirty.
+    char *allocate(uint32_t &pageId);
+    void unpin(uint32_t pageId, bool dirty);
+    // Writes every dirty page back.
+    bool flush();
+
+    size_t pageSize() const { return frameSize; }
+    size_t frameCount() const { return frames.size(); }
+    uint32_t pageCount() const { return pages; }
+    const Stats &stats() const { return counters; }
+    void resetStats() { counters = Stats(); }
+
+private:
+    struct Frame {
+        uint32_t pageId = 0;
+        int pins = 0;
+        bool used = false;
+        bool dirty = false;
+        bool referenced = false;
+    };
+
+    size_t frameSize;
+    unique_ptr<char[]> memory;
+    vector<Frame> frames;
+    unordered_map<uint32_t, size_t> resident;
+    size_t hand = 0;
+    int fd = -1;
+    uint32_t pages = 0;
+    Stats counters;
+
+    char *data(size_t frame) { return memory.get() + frame * frameSize; }
+    bool writeBack(size_t frame);
+    // Frees a frame for a new page; returns frames.size() if all are pinned.
+    size_t victim();
+};
+
+#endif
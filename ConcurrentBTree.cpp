@@ -0,0 +1,450 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "ConcurrentBTree.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+namespace {
+
+// ---- Epoch-based reclamation ----
+// Each thread claims one slot and publishes the global epoch in it for the
+// length of every tree operation. Retired memory is tagged with the epoch at
+// retirement and freed once every busy slot shows a later epoch, since any
+// thread that entered after the tag can no longer reach it.
+constexpr int kMaxThreads = 256;
+constexpr size_t kReclaimBatch = 64;
+constexpr uint64_t kIdle = 0;
+
+struct alignas(64) EpochSlot {
+    atomic<uint64_t> epoch{kIdle};
+    atomic<bool> claimed{false};
+};
+
+struct Retired {
+    uint64_t epoch;
+    void* ptr;
+    void (*destroy)(void*);
+};
+
+atomic<uint64_t> globalEpoch{1};
+EpochSlot epochSlots[kMaxThreads];
+mutex retiredLock;
+vector<Retired> retiredList;
+
+struct ThreadSlot {
+    EpochSlot* slot = nullptr;
+
+    ThreadSlot() {
+        for (EpochSlot &s : epochSlots) {
+            bool expected = false;
+            if (s.claimed.compare_exchange_strong(expected, true)) {
+                slot = &s;
+                return;
+            }
+        }
+        cerr << "ConcurrentBTree: more than " << kMaxThreads << " threads at once.\n";
+        abort();
+    }
+    ~ThreadSlot() {
+        slot->epoch.store(kIdle);
+        slot->claimed.store(false);
+    }
+};
+
+EpochSlot& currentSlot() {
+    thread_local ThreadSlot mine;
+    return *mine.slot;
+}
+
+// Pins the current epoch for the lifetime of one tree operation.
+struct EpochGuard {
+    EpochSlot &slot;
+    EpochGuard() : slot(currentSlot()) { slot.epoch.store(globalEpoch.load()); }
+    ~EpochGuard() { slot.epoch.store(kIdle); }
+};
+
+// Advances the epoch and frees everything no busy thread can still see.
+// Called with retiredLock held; returns the entries to destroy outside it.
+vector<Retired> collectReclaimable() {
+    globalEpoch.fetch_add(1);
+    uint64_t oldest = UINT64_MAX;
+    for (EpochSlot &s : epochSlots) {
+        uint64_t e = s.epoch.load();
+        if (e != kIdle) oldest = min(oldest, e);
+    }
+    auto ready = partition(retiredList.begin(), retiredList.end(),
+                           [oldest](const Retired &r) { return r.epoch >= oldest; });
+    vector<Retired> out(ready, retiredList.end());
+    retiredList.erase(ready, retiredList.end());
+    return out;
+}
+
+void retire(void* ptr, void (*destroy)(void*)) {
+    vector<Retired> ready;
+    {
+        lock_guard<mutex> guard(retiredLock);
+        retiredList.push_back({globalEpoch.load(), ptr, destroy});
+        if (retiredList.size() % kReclaimBatch != 0) return;
+        ready = collectReclaimable();
+    }
+    for (Retired &r : ready) r.destroy(r.ptr);
+}
+
+void reclaimNow() {
+    vector<Retired> ready;
+    {
+        lock_guard<mutex> guard(retiredLock);
+        ready = collectReclaimable();
+    }
+    for (Retired &r : ready) r.destroy(r.ptr);
+}
+
+void destroyRecord(void* p) { delete static_cast<Record*>(p); }
+
+// Spins briefly on a locked node, then yields so an oversubscribed machine
+// lets the lock holder run.
+void backoff(int &spins) {
+    if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        this_thread::yield();
+    }
+}
+
+// Fixed-size key slot. A reader may see a half-written slot, so the length
+// is clamped before use; the version check afterwards discards the result.
+struct Key {
+    uint8_t len = 0;
+    char bytes[ConcurrentBTree::kMaxKeyLength];
+
+    void assign(string_view s) {
+        len = (uint8_t)s.size();
+        memcpy(bytes, s.data(), s.size());
+    }
+    string_view view() const {
+        return {bytes, min<size_t>(len, ConcurrentBTree::kMaxKeyLength)};
+    }
+};
+
+constexpr int kLeafSlots = 64;
+constexpr int kInnerSlots = 64;
+
+// First slot whose key is >= key among the first count keys.
+int lowerBound(const Key* keys, int count, string_view key) {
+    int lo = 0, hi = max(0, min(count, kLeafSlots));
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (keys[mid].view() < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+}
+
+// ---- Nodes and version locks ----
+// version: bit 0 marks an unlinked (obsolete) node, bit 1 a held write lock,
+// the rest counts completed writes. Unlocking adds 0b10, which clears the
+// lock bit and bumps the count in one step.
+struct ConcurrentBTree::Node {
+    atomic<uint64_t> version{0b100};
+    const bool leaf;
+    uint16_t count = 0;
+
+    explicit Node(bool isLeaf) : leaf(isLeaf) {}
+
+    uint64_t readLockOrRestart(bool &restart) const {
+        uint64_t v = version.load();
+        for (int spins = 0; v & 0b10; v = version.load())
+            backoff(spins);
+        if (v & 0b01) restart = true;
+        return v;
+    }
+    // The fence keeps the plain reads made under v from sinking below the
+    // check.
+    void checkOrRestart(uint64_t v, bool &restart) const {
+        atomic_thread_fence(memory_order_acquire);
+        if (version.load() != v) restart = true;
+    }
+    bool tryUpgrade(uint64_t v) {
+        return version.compare_exchange_strong(v, v + 0b10);
+    }
+    void writeUnlock() { version.fetch_add(0b10); }
+    void writeUnlockObsolete() { version.fetch_add(0b11); }
+};
+
+struct ConcurrentBTree::Leaf : Node {
+    Key keys[kLeafSlots];
+    const Record* values[kLeafSlots];
+    Leaf() : Node(true) {}
+};
+
+// children[i] holds keys in (keys[i - 1], keys[i]]; the last child has no
+// upper bound.
+struct ConcurrentBTree::Inner : Node {
+    Key keys[kInnerSlots];
+    Node* children[kInnerSlots + 1];
+    Inner() : Node(false) {}
+};
+
+ConcurrentBTree::ConcurrentBTree() : root(new Leaf()) {}
+
+ConcurrentBTree::~ConcurrentBTree() {
+    vector<Node*> work{root.load()};
+    while (!work.empty()) {
+        Node* node = work.back();
+        work.pop_back();
+        if (node->leaf) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            for (int i = 0; i < leaf->count; ++i)
+                delete leaf->values[i];
+            delete leaf;
+        } else {
+            Inner* inner = static_cast<Inner*>(node);
+            for (int i = 0; i <= inner->count; ++i)
+                work.push_back(inner->children[i]);
+            delete inner;
+        }
+    }
+    reclaimNow();
+}
+
+bool ConcurrentBTree::insert(string_view key, const Record& record) {
+    if (key.size() > kMaxKeyLength) {
+        cerr << "Key " << key << " is longer than " << kMaxKeyLength << " bytes.\n";
+        return false;
+    }
+    // Allocated before any lock is taken so the critical section stays short.
+    auto owned = make_unique<Record>(record);
+    EpochGuard guard;
+    while (true) {
+        Attempt a = tryInsert(key, owned.get());
+        if (a == Attempt::Done) {
+            owned.release();
+            return true;
+        }
+        if (a == Attempt::Failed) return false;
+    }
+}
+
+optional<Record> ConcurrentBTree::search(string_view key) const {
+    if (key.size() > kMaxKeyLength) return nullopt;
+    EpochGuard guard;
+    while (true) {
+        bool restart = false;
+        Node* node = root.load();
+        uint64_t version = node->readLockOrRestart(restart);
+        if (restart || node != root.load()) continue;
+
+        while (!node->leaf && !restart) {
+            Inner* inner = static_cast<Inner*>(node);
+            uint64_t parentVersion = version;
+            node = inner->children[lowerBound(inner->keys, inner->count, key)];
+            // Validate before touching the child, as the pointer may be torn,
+            // and again after, as the child may have split in between.
+            inner->checkOrRestart(parentVersion, restart);
+            if (!restart) version = node->readLockOrRestart(restart);
+            if (!restart) inner->checkOrRestart(parentVersion, restart);
+        }
+        if (restart) continue;
+
+        Leaf* leaf = static_cast<Leaf*>(node);
+        int pos = lowerBound(leaf->keys, leaf->count, key);
+        const Record* found = nullptr;
+        if (pos < min<int>(leaf->count, kLeafSlots) && leaf->keys[pos].view() == key)
+            found = leaf->values[pos];
+        leaf->checkOrRestart(version, restart);
+        if (restart) continue;
+        // Published records never change and the guard keeps this one alive.
+        if (!found) return nullopt;
+        return *found;
+    }
+}
+
+bool ConcurrentBTree::remove(string_view key) {
+    if (key.size() > kMaxKeyLength) return false;
+    EpochGuard guard;
+    while (true) {
+        Attempt a = tryRemove(key);
+        if (a != Attempt::Restart) return a == Attempt::Done;
+    }
+}
+
+// Write-locks parent (if any) and node, both at the versions they were read
+// at. On failure nothing is left locked and the caller restarts.
+bool ConcurrentBTree::lockForSplit(Inner* parent, uint64_t parentVersion, Node* node, uint64_t version) {
+    if (parent && !parent->tryUpgrade(parentVersion)) return false;
+    if (!node->tryUpgrade(version)) {
+        if (parent) parent->writeUnlock();
+        return false;
+    }
+    // Without a parent the node must still be the root, or a concurrent
+    // root split has given it one we do not hold.
+    if (!parent && root.load() != node) {
+        node->writeUnlock();
+        return false;
+    }
+    return true;
+}
+
+// Links right in after left. Parent and left are locked; parent has room
+// because full inner nodes are split on the way down.
+void ConcurrentBTree::installSplit(Inner* parent, Node* left, string_view separator, Node* right) {
+    if (!parent) {
+        Inner* newRoot = new Inner();
+        newRoot->count = 1;
+        newRoot->keys[0].assign(separator);
+        newRoot->children[0] = left;
+        newRoot->children[1] = right;
+        root.store(newRoot);
+        return;
+    }
+    int pos = lowerBound(parent->keys, parent->count, separator);
+    for (int i = parent->count; i > pos; --i) {
+        parent->keys[i] = parent->keys[i - 1];
+        parent->children[i + 1] = parent->children[i];
+    }
+    parent->keys[pos].assign(separator);
+    parent->children[pos + 1] = right;
+    ++parent->count;
+}
+
+ConcurrentBTree::Attempt ConcurrentBTree::tryInsert(string_view key, const Record* record) {
+    bool restart = false;
+    Node* node = root.load();
+    uint64_t version = node->readLockOrRestart(restart);
+    if (restart || node != root.load()) return Attempt::Restart;
+    Inner* parent = nullptr;
+    uint64_t parentVersion = 0;
+
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        if (inner->count == kInnerSlots) {
+            if (!lockForSplit(parent, parentVersion, inner, version)) return Attempt::Restart;
+            int mid = inner->count / 2;
+            Inner* right = new Inner();
+            right->count = (uint16_t)(inner->count - mid - 1);
+            copy(inner->keys + mid + 1, inner->keys + inner->count, right->keys);
+            copy(inner->children + mid + 1, inner->children + inner->count + 1, right->children);
+            Key separator = inner->keys[mid];
+            inner->count = (uint16_t)mid;
+            installSplit(parent, inner, separator.view(), right);
+            inner->writeUnlock();
+            if (parent) parent->writeUnlock();
+            return Attempt::Restart;
+        }
+        parent = inner;
+        parentVersion = version;
+        node = inner->children[lowerBound(inner->keys, inner->count, key)];
+        inner->checkOrRestart(parentVersion, restart);
+        if (restart) return Attempt::Restart;
+        version = node->readLockOrRestart(restart);
+        inner->checkOrRestart(parentVersion, restart);
+        if (restart) return Attempt::Restart;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    if (leaf->count == kLeafSlots) {
+        if (!lockForSplit(parent, parentVersion, leaf, version)) return Attempt::Restart;
+        int mid = leaf->count / 2;
+        Leaf* right = new Leaf();
+        right->count = (uint16_t)(leaf->count - mid);
+        copy(leaf->keys + mid, leaf->keys + leaf->count, right->keys);
+        copy(leaf->values + mid, leaf->values + leaf->count, right->values);
+        leaf->count = (uint16_t)mid;
+        Key separator = leaf->keys[mid - 1];
+        installSplit(parent, leaf, separator.view(), right);
+        leaf->writeUnlock();
+        if (parent) parent->writeUnlock();
+        return Attempt::Restart;
+    }
+
+    if (!leaf->tryUpgrade(version)) return Attempt::Restart;
+    int pos = lowerBound(leaf->keys, leaf->count, key);
+    if (pos < leaf->count && leaf->keys[pos].view() == key) {
+        leaf->writeUnlock();
+        return Attempt::Failed;
+    }
+    for (int i = leaf->count; i > pos; --i) {
+        leaf->keys[i] = leaf->keys[i - 1];
+        leaf->values[i] = leaf->values[i - 1];
+    }
+    leaf->keys[pos].assign(key);
+    leaf->values[pos] = record;
+    ++leaf->count;
+    leaf->writeUnlock();
+    return Attempt::Done;
+}
+
+// Leaves are never rebalanced. A leaf emptied by its last remove is unlinked
+// from its parent instead, which keeps remove to at most two locks; the
+// neighbour absorbs its key range.
+ConcurrentBTree::Attempt ConcurrentBTree::tryRemove(string_view key) {
+    bool restart = false;
+    Node* node = root.load();
+    uint64_t version = node->readLockOrRestart(restart);
+    if (restart || node != root.load()) return Attempt::Restart;
+    Inner* parent = nullptr;
+    uint64_t parentVersion = 0;
+    int childPos = 0;
+
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        parent = inner;
+        parentVersion = version;
+        childPos = lowerBound(inner->keys, inner->count, key);
+        node = inner->children[childPos];
+        inner->checkOrRestart(parentVersion, restart);
+        if (restart) return Attempt::Restart;
+        version = node->readLockOrRestart(restart);
+        inner->checkOrRestart(parentVersion, restart);
+        if (restart) return Attempt::Restart;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int pos = lowerBound(leaf->keys, leaf->count, key);
+    bool present = pos < min<int>(leaf->count, kLeafSlots) && leaf->keys[pos].view() == key;
+    bool unlink = leaf->count == 1 && parent && parent->count > 0;
+    leaf->checkOrRestart(version, restart);
+    if (restart) return Attempt::Restart;
+    if (!present) return Attempt::Failed;
+
+    if (unlink) {
+        if (!lockForSplit(parent, parentVersion, leaf, version)) return Attempt::Restart;
+        const Record* removed = leaf->values[0];
+        int sep = childPos < parent->count ? childPos : childPos - 1;
+        for (int i = sep; i + 1 < parent->count; ++i)
+            parent->keys[i] = parent->keys[i + 1];
+        for (int i = childPos; i < parent->count; ++i)
+            parent->children[i] = parent->children[i + 1];
+        --parent->count;
+        leaf->count = 0;
+        leaf->writeUnlockObsolete();
+        parent->writeUnlock();
+        retire(const_cast<Record*>(removed), destroyRecord);
+        retire(leaf, [](void* p) { delete static_cast<Leaf*>(p); });
+        return Attempt::Done;
+    }
+
+    if (!leaf->tryUpgrade(version)) return Attempt::Restart;
+    const Record* removed = leaf->values[pos];
+    for (int i = pos; i + 1 < leaf->count; ++i) {
+        leaf->keys[i] = leaf->keys[i + 1];
+        leaf->values[i] = leaf->values[i + 1];
+    }
+    --leaf->count;
+    leaf->writeUnlock();
+    retire(const_cast<Record*>(removed), destroyRecord);
+    return Attempt::Done;
+}
@@ -0,0 +1,57 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef CONCURRENTBTREE_H
+#define CONCURRENTBTREE_H
+
+#include "Record.h"
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+using namespace std;
+
+// B+tree that any number of threads may search and modify at once, using
+// optimistic lock coupling. Every node carries a version word: readers never
+// write shared memory, they note a node's version, read the node and restart
+// from the root if the version moved underneath them. Writers lock only the
+// nodes they change: the leaf for a plain insert or remove, plus its parent
+// while a split installs a separator or an emptied leaf is unlinked.
+//
+// Keys are copied into fixed-size slots of at most kMaxKeyLength bytes, so a
+// reader racing a writer sees stale bytes, never freed memory. Records are
+// immutable once published. Removed records and unlinked leaves are retired
+// through an epoch scheme and freed only after every thread that could still
+// be reading them has finished its operation. Keys are unique: insert keeps
+// the first record, as BTree::search returns the oldest one.
+class ConcurrentBTree {
+public:
+    static constexpr size_t kMaxKeyLength = 31;
+
+    ConcurrentBTree();
+    ~ConcurrentBTree();
+    ConcurrentBTree(const ConcurrentBTree&) = delete;
+    ConcurrentBTree& operator=(const ConcurrentBTree&) = delete;
+
+    // Returns false if the key is already present or longer than kMaxKeyLength.
+    bool insert(string_view key, const Record& record);
+    optional<Record> search(string_view key) const;
+    // Returns false if the key was not present.
+    bool remove(string_view key);
+
+private:
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    enum class Attempt { Restart, Done, Failed };
+
+    atomic<Node*> root;
+
+    Attempt tryInsert(string_view key, const Record* record);
+    Attempt tryRemove(string_view key);
+    bool lockForSplit(Inner* parent, uint64_t parentVersion, Node* node, uint64_t version);
+    void installSplit(Inner* parent, Node* left, string_view separator, Node* right);
+};
+
+#endif
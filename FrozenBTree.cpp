@@ -0,0 +1,115 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "FrozenBTree.h"
+#include "Prefetch.h"
+#include <algorithm>
+#include <bit>
+using namespace std;
+
+// Bytes are compared as unsigned big-endian words, so hi/lo order keys like
+// the strings do. Keys of up to 15 bytes are encoded exactly: zero padding
+// ties are broken by the length byte, and a string that is a prefix of
+// another gets the smaller length. Only two keys of 16+ bytes that agree on
+// their first 15 bytes pack to the same Slot and need a full compare.
+FrozenBTree::Slot FrozenBTree::packKey(string_view key) {
+    unsigned char buf[16] = {};
+    copy_n(key.data(), min<size_t>(15, key.size()), buf);
+    buf[15] = (unsigned char)min<size_t>(16, key.size());
+    Slot s{0, 0};
+    for (int i = 0; i < 8; ++i) {
+        s.hi = (s.hi << 8) | buf[i];
+        s.lo = (s.lo << 8) | buf[8 + i];
+    }
+    return s;
+}
+
+void FrozenBTree::build(vector<pair<string, vector<Record>*>> entries) {
+    size_t n = entries.size();
+    keys.resize(n);
+    postings.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = std::move(entries[i].first);
+        postings[i] = entries[i].second;
+    }
+
+    // In-order walk of the implicit tree (children of k are 2k and 2k + 1)
+    // hands out the sorted entries one by one.
+    slots.assign(n + 1, Slot{0, 0});
+    ranks.assign(n + 1, 0);
+    size_t k = 1;
+    while (2 * k <= n)
+        k *= 2;
+    for (size_t i = 0; i < n; ++i) {
+        slots[k] = packKey(keys[i]);
+        ranks[k] = (uint32_t)i;
+        if (2 * k + 1 <= n) {
+            k = 2 * k + 1;
+            while (2 * k <= n)
+                k *= 2;
+        } else {
+            while (k & 1)
+                k >>= 1;
+            k >>= 1;
+        }
+    }
+}
+
+bool FrozenBTree::slotBefore(size_t k, const Slot& probe, string_view key) const {
+    const Slot& s = slots[k];
+    if (s.hi != probe.hi) return s.hi < probe.hi;
+    if (s.lo != probe.lo) return s.lo < probe.lo;
+    if ((s.lo & 0xFF) < 16) return false;
+    return keys[ranks[k]] < key;
+}
+
+// Sorted position of the first key >= key, or size() if there is none.
+size_t FrozenBTree::lowerBound(string_view key) const {
+    const size_t n = keys.size();
+    const Slot probe = packKey(key);
+    size_t k = 1;
+    while (k <= n) {
+        // The four grandchildren of k are adjacent: one or two cache lines.
+        size_t ahead = 4 * k;
+        if (ahead + 3 <= n) {
+            prefetchRead(&slots[ahead]);
+            prefetchRead(&slots[ahead + 3]);
+        }
+        k = 2 * k + slotBefore(k, probe, key);
+    }
+    // k went right after every "before" and left once at the answer; drop the
+    // trailing right turns and that last left turn to get back to it.
+    k >>= countr_one(k) + 1;
+    return k == 0 ? n : ranks[k];
+}
+
+Record* FrozenBTree::search(string_view key) const {
+    size_t i = lowerBound(key);
+    if (i < keys.size() && keys[i] == key)
+        return &postings[i]->front();
+    return nullptr;
+}
+
+span<Record> FrozenBTree::searchAll(string_view key) const {
+    size_t i = lowerBound(key);
+    if (i < keys.size() && keys[i] == key)
+        return *postings[i];
+    return {};
+}
+
+size_t FrozenBTree::rangeScan(string_view lo, string_view hi,
+                              const function<void(const string&, const Record&)>& visit) const {
+    if (!(lo < hi)) return 0;
+    size_t visited = 0;
+    for (size_t i = lowerBound(lo); i < keys.size() && keys[i] < hi; ++i) {
+        for (const Record& r : *postings[i])
+            visit(keys[i], r);
+        visited += postings[i]->size();
+    }
+    return visited;
+}
+
+size_t FrozenBTree::size() const {
+    return keys.size();
+}
@@ -0,0 +1,50 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef FROZENBTREE_H
+#define FROZENBTREE_H
+
+#include "Record.h"
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Read-only search structure over a BTree's entries (BTree::freeze). Every key
+// is packed into a 16-byte order-preserving prefix and the prefixes are laid
+// out in Eytzinger (breadth-first) order in one contiguous array, so a lookup
+// walks a fixed index pattern that is prefetched two levels ahead instead of
+// chasing node pointers. Keys are copied out of the tree's prefix-truncated
+// nodes; records are referenced in place, which is why the owning tree drops
+// the snapshot on its next mutation.
+class FrozenBTree {
+private:
+    struct Slot {
+        uint64_t hi;  // key bytes 0-7, big-endian
+        uint64_t lo;  // key bytes 8-14, then min(length, 16) in the low byte
+    };
+
+    vector<Slot> slots;            // 1-based Eytzinger order; slots[0] unused
+    vector<uint32_t> ranks;        // sorted position of the key in slots[k]
+    vector<string> keys;           // sorted order
+    vector<vector<Record>*> postings;
+
+    static Slot packKey(string_view key);
+    bool slotBefore(size_t k, const Slot& probe, string_view key) const;
+    size_t lowerBound(string_view key) const;
+
+public:
+    // entries must be in ascending key order.
+    void build(vector<pair<string, vector<Record>*>> entries);
+    Record* search(string_view key) const;
+    span<Record> searchAll(string_view key) const;
+    size_t rangeScan(string_view lo, string_view hi,
+                     const function<void(const string&, const Record&)>& visit) const;
+    size_t size() const;
+};
+
+#endif
@@ -3,26 +3,52 @@
 //
 
 #include "HashMap.h"
-#include <iostream>
-#include <iomanip>
+#include "Prefetch.h"
+#include "Key.h"
+#include <algorithm>
 using namespace std;
 
 HashMap::HashMap(int size) : capacity(size) {
     table.resize(size);
 }
 
-int HashMap::hashFunc(const string &key) {
-    unsigned long hash = 5381;
-    for (char c : key) hash = ((hash << 5) + hash) + c;
-    return hash % capacity;
+unsigned long HashMap::djb2(unsigned long hash, string_view bytes) {
+    for (char c : bytes) hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+unsigned long HashMap::hashKey(string_view key) {
+    return djb2(5381, key);
+}
+
+int HashMap::hashFunc(string_view key) {
+    return djb2(5381, key) % capacity;
+}
+
+// Same value as hashFunc(state + "_" + yearDigits), fed part by part.
+int HashMap::hashFunc(string_view state, string_view yearDigits) {
+    return djb2(djb2(djb2(5381, state), "_"), yearDigits) % capacity;
+}
+
+// Keys look like "State_Year"; the state is everything before the last '_'.
+string_view HashMap::stateOf(string_view key) {
+    size_t pos = key.rfind('_');
+    return pos == string_view::npos ? key : key.substr(0, pos);
 }
 
 void HashMap::insert(const string &key, const Record &record) {
     int index = hashFunc(key);
     table[index].push_back({key, record});
+    ++count;
+
+    string_view state = stateOf(key);
+    auto it = stateIndex.find(state);
+    if (it == stateIndex.end())
+        it = stateIndex.emplace(string(state), vector<const pair<string, Record>*>()).first;
+    it->second.push_back(&table[index].back());
 }
 
-Record* HashMap::search(const string &key) {
+Record* HashMap::search(string_view key) {
     int index = hashFunc(key);
     for (auto &p : table[index]) {
         if (p.first == key)
@@ -31,11 +57,76 @@ Record* HashMap::search(const string &key) {
     return nullptr;
 }
 
-void HashMap::remove(const string &key) {
+Record* HashMap::search(string_view state, int year) {
+    YearDigits digits(year);
+    int index = hashFunc(state, digits.view());
+    for (auto &p : table[index]) {
+        if (keyEqualsParts(p.first, state, digits.view()))
+            return &p.second;
+    }
+    return nullptr;
+}
+
+void HashMap::searchBatch(span<const string_view> keys, span<Record*> out) {
+    constexpr size_t kGroup = 16;
+    int index[kGroup];
+
+    for (size_t base = 0; base < keys.size(); base += kGroup) {
+        size_t n = min(kGroup, keys.size() - base);
+
+        for (size_t i = 0; i < n; ++i) {
+            index[i] = hashFunc(keys[base + i]);
+            prefetchRead(&table[index[i]]);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (!table[index[i]].empty())
+                prefetchRead(&table[index[i]].front());
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (!table[index[i]].empty())
+                prefetchRead(table[index[i]].front().first.data());
+        }
+        for (size_t i = 0; i < n; ++i) {
+            Record *found = nullptr;
+            for (auto &p : table[index[i]]) {
+                if (p.first == keys[base + i]) {
+                    found = &p.second;
+                    break;
+                }
+            }
+            out[base + i] = found;
+        }
+    }
+}
+
+void HashMap::eraseEntry(int index, list<pair<string, Record>>::iterator it) {
+    auto stateIt = stateIndex.find(stateOf(it->first));
+    if (stateIt != stateIndex.end()) {
+        auto &entries = stateIt->second;
+        entries.erase(std::find(entries.begin(), entries.end(), &*it));
+        if (entries.empty())
+            stateIndex.erase(stateIt);
+    }
+    table[index].erase(it);
+    --count;
+}
+
+void HashMap::remove(string_view key) {
     int index = hashFunc(key);
     for (auto it = table[index].begin(); it != table[index].end(); ++it) {
         if (it->first == key) {
-            table[index].erase(it);
+            eraseEntry(index, it);
+            return;
+        }
+    }
+}
+
+void HashMap::remove(string_view state, int year) {
+    YearDigits digits(year);
+    int index = hashFunc(state, digits.view());
+    for (auto it = table[index].begin(); it != table[index].end(); ++it) {
+        if (keyEqualsParts(it->first, state, digits.view())) {
+            eraseEntry(index, it);
             return;
         }
     }
@@ -43,55 +134,33 @@ void HashMap::remove(const string &key) {
 
 
 void HashMap::display() {
-    cout << "\n============================================================================================================================\n";
-    cout << "                                                   All Records\n";
-    cout << "============================================================================================================================\n";
-
-    cout << left
-         << setw(12) << "State"
-         << setw(6)  << "Year"
-         << setw(10) << "Firms"
-         << setw(12) << "NetJob"
-         << setw(10) << "JobRate"
-         << setw(12) << "Realloc"
-         << setw(12) << "Entered"
-         << setw(10) << "EntRate"
-         << setw(10) << "Exited"
-         << setw(10) << "ExRate"
-         << setw(10) << "PhysLoc"
-         << setw(10) << "FirmEx"
-         << setw(12) << "JobCreate"
-         << setw(10) << "CreateR"
-         << setw(12) << "JobDestr"
-         << setw(10) << "DestrR"
-         << endl;
-
-    cout << string(160, '-') << endl;
-
-    for (int i = 0; i < capacity; ++i) {
+    ReportWriter writer{ReportOptions()};
+    display(writer);
+}
+
+void HashMap::display(ReportWriter &writer) const {
+    writer.text("\n============================================================================================================================\n");
+    writer.text("                                                   All Records\n");
+    writer.text("============================================================================================================================\n");
+
+    writeRecordTableHeader(writer);
+
+    for (int i = 0; i < capacity && !writer.pageFull(); ++i) {
         for (auto &p : table[i]) {
-            const Record &r = p.second;
-            cout << left << setw(12) << r.state
-                 << setw(6)  << r.year
-                 << setw(10) << r.numberOfFirms
-                 << setw(12) << r.netJobCreation
-                 << setw(10) << fixed << setprecision(2) << r.netJobCreationRate
-                 << setw(12) << fixed << setprecision(2) << r.reallocationRate
-                 << setw(12) << r.establishmentsEntered
-                 << setw(10) << fixed << setprecision(2) << r.enteredRate
-                 << setw(10) << r.establishmentsExited
-                 << setw(10) << fixed << setprecision(2) << r.exitedRate
-                 << setw(10) << r.physicalLocations
-                 << setw(10) << r.firmExits
-                 << setw(12) << r.jobCreation
-                 << setw(10) << fixed << setprecision(2) << r.jobCreationRate
-                 << setw(12) << r.jobDestruction
-                 << setw(10) << fixed << setprecision(2) << r.jobDestructionRate
-                 << endl;
+            if (writer.beginRow())
+                writeRecordRow(writer, p.second);
         }
     }
 
-    cout << "============================================================================================================================\n";
+    writer.text("============================================================================================================================\n");
+    writer.flush();
+}
+
+void HashMap::forEach(const function<void(const string&, const Record&)> &visit) const {
+    for (const auto &bucket : table) {
+        for (const auto &entry : bucket)
+            visit(entry.first, entry.second);
+    }
 }
 
 std::vector<std::string> HashMap::getAllKeys() const {
@@ -104,12 +173,33 @@ std::vector<std::string> HashMap::getAllKeys() const {
     return keys;
 }
 
+// Copies every entry into a minimal perfect hash index.
+PerfectHashIndex HashMap::freeze() const {
+    std::vector<std::pair<std::string, Record>> entries;
+    for (const auto &bucket : table) {
+        for (const auto &entry : bucket)
+            entries.push_back(entry);
+    }
+    PerfectHashIndex index;
+    index.build(std::move(entries));
+    return index;
+}
+
+// Answered from the state index: a state whose name starts with the prefix
+// contributes all its rows, a state that is itself a prefix of the prefix
+// (e.g. "Texas" for "Texas_19") has its rows filtered, and every other state
+// is skipped without touching its entries.
 std::vector<std::pair<std::string, Record>> HashMap::searchPrefix(const std::string& prefix) const {
     std::vector<std::pair<std::string, Record>> results;
-    for (const auto &bucket : table) {
-        for (const auto &entry : bucket) {
-            if (entry.first.substr(0, prefix.length()) == prefix) {
-                results.push_back(entry);
+    for (const auto &group : stateIndex) {
+        const string &state = group.first;
+        if (state.starts_with(prefix)) {
+            for (const auto *entry : group.second)
+                results.push_back(*entry);
+        } else if (prefix.starts_with(state)) {
+            for (const auto *entry : group.second) {
+                if (entry->first.starts_with(prefix))
+                    results.push_back(*entry);
             }
         }
     }
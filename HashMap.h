@@ -6,24 +6,100 @@
 #define HASHMAP_H
 
 #include "Record.h"
+#include "PerfectHashIndex.h"
+#include "ReportWriter.h"
+#include <cstddef>
+#include <functional>
+#include <iterator>
 #include <vector>
 #include <list>
+#include <map>
+#include <span>
 #include <string>
+#include <string_view>
 using namespace std;
 
 class HashMap {
 private:
     vector<list<pair<string, Record>>> table;
     int capacity;
-    int hashFunc(const string &key);
+    size_t count = 0;
+    // Secondary index: state part of the key ("Texas" for "Texas_1995") -> its
+    // entries, so per-state queries only touch that state's rows.
+    map<string, vector<const pair<string, Record>*>, less<>> stateIndex;
+    int hashFunc(string_view key);
+    int hashFunc(string_view state, string_view yearDigits);
+    static unsigned long djb2(unsigned long hash, string_view bytes);
+    static string_view stateOf(string_view key);
+    void eraseEntry(int index, list<pair<string, Record>>::iterator it);
 
 public:
+    // Walks every entry bucket by bucket without copying keys or records.
+    class const_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = pair<string, Record>;
+        using difference_type = ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+        reference operator*() const { return *entry; }
+        pointer operator->() const { return &*entry; }
+        const_iterator& operator++() { ++entry; skipEmpty(); return *this; }
+        const_iterator operator++(int) { const_iterator tmp = *this; ++*this; return tmp; }
+        bool operator==(const const_iterator &other) const {
+            return bucket == other.bucket && (bucket == last || entry == other.entry);
+        }
+
+    private:
+        friend class HashMap;
+        using BucketIt = vector<list<pair<string, Record>>>::const_iterator;
+        BucketIt bucket, last;
+        list<pair<string, Record>>::const_iterator entry;
+
+        const_iterator(BucketIt first, BucketIt end) : bucket(first), last(end) {
+            if (bucket != last) {
+                entry = bucket->begin();
+                skipEmpty();
+            }
+        }
+        void skipEmpty() {
+            while (entry == bucket->end()) {
+                if (++bucket == last) return;
+                entry = bucket->begin();
+            }
+        }
+    };
+
     HashMap(int size);
+    // Raw DJB2 hash of a key, before it is reduced to a bucket index.
+    static unsigned long hashKey(string_view key);
+    HashMap(const HashMap&) = delete;             // stateIndex points into table
+    HashMap& operator=(const HashMap&) = delete;
     void insert(const string &key, const Record &record);
-    Record* search(const string &key);
-    void remove(const string &key);
+    Record* search(string_view key);
+    // Composite lookups hash and compare the state and year directly, so the
+    // caller never builds the "State_Year" string.
+    Record* search(string_view state, int year);
+    // Looks up keys in groups, prefetching bucket, node and key bytes for the
+    // whole group before resolving any of them. out[i] receives the match for
+    // keys[i] or nullptr; out must be at least as long as keys.
+    void searchBatch(span<const string_view> keys, span<Record*> out);
+    void remove(string_view key);
+    void remove(string_view state, int year);
+    // Number of entries, counting every record of a duplicate key.
+    size_t size() const { return count; }
     void display();
+    void display(ReportWriter &writer) const;
+    const_iterator begin() const { return const_iterator(table.begin(), table.end()); }
+    const_iterator end() const { return const_iterator(table.end(), table.end()); }
+    // Calls visit(key, record) for every entry in one pass over the table.
+    void forEach(const function<void(const string&, const Record&)> &visit) const;
     std::vector<std::string> getAllKeys() const;
+    // Snapshot of the current contents behind a minimal perfect hash, for
+    // read-only analysis. Later changes to the map are not reflected.
+    PerfectHashIndex freeze() const;
     std::vector<std::pair<std::string, Record>> searchPrefix(const std::string& prefix) const;
 
 };
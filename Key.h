@@ -0,0 +1,51 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef KEY_H
+#define KEY_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Record keys are "State_Year", e.g. "Texas_1995". makeKey is the one place
+// that concatenates them; the composite lookups below work on the parts.
+inline string makeKey(string_view state, int year) {
+    string key;
+    key.reserve(state.size() + 12);
+    key.append(state);
+    key.push_back('_');
+    key.append(to_string(year));
+    return key;
+}
+
+// Decimal digits of a year, formatted on the stack.
+struct YearDigits {
+    char buf[12];
+    size_t len;
+
+    explicit YearDigits(int year) {
+        len = to_chars(buf, buf + sizeof(buf), year).ptr - buf;
+    }
+    string_view view() const { return string_view(buf, len); }
+};
+
+inline bool keyEqualsParts(string_view key, string_view state, string_view digits) {
+    return key.size() == state.size() + 1 + digits.size()
+        && key.compare(0, state.size(), state) == 0
+        && key[state.size()] == '_'
+        && key.compare(state.size() + 1, digits.size(), digits) == 0;
+}
+
+// "State_Year" as one integer for BasicBTree<uint64_t, ...>: a state code
+// in the high half and the year, sign bit flipped so it orders as unsigned,
+// in the low half. Codes handed out in state-name order keep keys in the same
+// order as their strings for years of equal width.
+inline uint64_t packKey(uint32_t stateCode, int year) {
+    return (uint64_t)stateCode << 32 | ((uint32_t)year ^ 0x80000000u);
+}
+
+#endif
@@ -0,0 +1,36 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "NumericField.h"
+using namespace std;
+
+const vector<NumericField>& numericFields() {
+    static const vector<NumericField> fields = {
+        {"year", &Record::year, nullptr},
+        {"dhsDenominator", &Record::dhsDenominator, nullptr},
+        {"numberOfFirms", &Record::numberOfFirms, nullptr},
+        {"netJobCreation", &Record::netJobCreation, nullptr},
+        {"netJobCreationRate", nullptr, &Record::netJobCreationRate},
+        {"reallocationRate", nullptr, &Record::reallocationRate},
+        {"establishmentsEntered", &Record::establishmentsEntered, nullptr},
+        {"enteredRate", nullptr, &Record::enteredRate},
+        {"establishmentsExited", &Record::establishmentsExited, nullptr},
+        {"exitedRate", nullptr, &Record::exitedRate},
+        {"physicalLocations", &Record::physicalLocations, nullptr},
+        {"firmExits", &Record::firmExits, nullptr},
+        {"jobCreation", &Record::jobCreation, nullptr},
+        {"jobCreationRate", nullptr, &Record::jobCreationRate},
+        {"jobDestruction", &Record::jobDestruction, nullptr},
+        {"jobDestructionRate", nullptr, &Record::jobDestructionRate},
+    };
+    return fields;
+}
+
+const NumericField* findNumericField(string_view name) {
+    for (const NumericField& field : numericFields()) {
+        if (name == field.name)
+            return &field;
+    }
+    return nullptr;
+}
@@ -0,0 +1,27 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef NUMERICFIELD_H
+#define NUMERICFIELD_H
+
+#include "Record.h"
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// A numeric Record field that can be indexed or aggregated, e.g. jobCreation.
+// Exactly one of the two member pointers is set.
+struct NumericField {
+    const char* name;
+    int Record::*intValue;
+    float Record::*floatValue;
+
+    double value(const Record& r) const { return intValue ? (double)(r.*intValue) : (double)(r.*floatValue); }
+};
+
+// Every numeric field, in Record order.
+const vector<NumericField>& numericFields();
+const NumericField* findNumericField(string_view name);
+
+#endif
@@ -0,0 +1,457 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "PagedBTree.h"
+#include "RecordIO.h"
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+namespace {
+
+const char kMagic[8] = {'B', 'D', 'X', 'P', 'A', 'G', 'E', '1'};
+const size_t kMinPageSize = 4096;
+const size_t kMaxPageSize = 32768;
+const size_t kMinPoolPages = 8;
+
+// Node page header: leaf flag, cell count, start of the cell area, right
+// sibling (leaves) and the child left of the first separator (inner nodes).
+// Page 0 is the file header, so 0 doubles as "no page".
+const size_t kHeaderSize = 16;
+const size_t kLeafOffset = 0;
+const size_t kCountOffset = 2;
+const size_t kCellStartOffset = 4;
+const size_t kNextOffset = 8;
+const size_t kLeftmostOffset = 12;
+
+// File header page: magic, page size, root page id, record count.
+const size_t kPageSizeOffset = 8;
+const size_t kRootOffset = 12;
+const size_t kRecordsOffset = 16;
+
+template <class T>
+T load(const char *p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template <class T>
+void store(char *p, T value) {
+    memcpy(p, &value, sizeof(T));
+}
+
+// Leaf cell: key length, value length, key, encoded record.
+// Inner cell: key length, right child page id, key.
+string leafCell(string_view key, const Record &r) {
+    size_t valueSize = encodedRecordSize(r);
+    string cell(4 + key.size() + valueSize, '\0');
+    store<uint16_t>(cell.data(), (uint16_t)key.size());
+    store<uint16_t>(cell.data() + 2, (uint16_t)valueSize);
+    memcpy(cell.data() + 4, key.data(), key.size());
+    encodeRecord(cell.data() + 4 + key.size(), r);
+    return cell;
+}
+
+string innerCell(string_view key, uint32_t child) {
+    string cell(6 + key.size(), '\0');
+    store<uint16_t>(cell.data(), (uint16_t)key.size());
+    store<uint32_t>(cell.data() + 2, child);
+    memcpy(cell.data() + 6, key.data(), key.size());
+    return cell;
+}
+
+// View over one node page.
+struct Page {
+    char *data;
+    size_t size;
+
+    bool leaf() const { return data[kLeafOffset] != 0; }
+    int count() const { return load<uint16_t>(data + kCountOffset); }
+    size_t cellStart() const { return load<uint16_t>(data + kCellStartOffset); }
+    uint32_t next() const { return load<uint32_t>(data + kNextOffset); }
+    void setNext(uint32_t page) { store(data + kNextOffset, page); }
+    uint32_t leftmost() const { return load<uint32_t>(data + kLeftmostOffset); }
+    void setLeftmost(uint32_t page) { store(data + kLeftmostOffset, page); }
+
+    void init(bool isLeaf) {
+        memset(data, 0, kHeaderSize);
+        data[kLeafOffset] = isLeaf;
+        store<uint16_t>(data + kCellStartOffset, (uint16_t)size);
+    }
+
+    const char *cell(int i) const { return data + load<uint16_t>(data + kHeaderSize + 2 * i); }
+    string_view key(int i) const {
+        const char *c = cell(i);
+        return {c + (leaf() ? 4 : 6), load<uint16_t>(c)};
+    }
+    string_view value(int i) const {
+        const char *c = cell(i);
+        return {c + 4 + load<uint16_t>(c), load<uint16_t>(c + 2)};
+    }
+    // Child i of an inner node; cell i - 1 holds the one right of key i - 1.
+    uint32_t child(int i) const { return i == 0 ? leftmost() : load<uint32_t>(cell(i - 1) + 2); }
+    size_t cellSize(int i) const {
+        const char *c = cell(i);
+        return leaf() ? 4 + load<uint16_t>(c) + load<uint16_t>(c + 2) : 6 + load<uint16_t>(c);
+    }
+    string cellBytes(int i) const { return string(cell(i), cellSize(i)); }
+
+    int lowerBound(string_view k) const {
+        int lo = 0, hi = count();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (key(mid) < k) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    int upperBound(string_view k) const {
+        int lo = 0, hi = count();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (k < key(mid)) hi = mid;
+            else lo = mid + 1;
+        }
+        return lo;
+    }
+
+    // Repacks live cells against the end of the page, reclaiming the space
+    // erased cells left behind.
+    void compact() {
+        string packed;
+        vector<uint16_t> sizes;
+        for (int i = 0; i < count(); ++i) {
+            sizes.push_back((uint16_t)cellSize(i));
+            packed.append(cell(i), sizes.back());
+        }
+        size_t end = size, from = 0;
+        for (int i = 0; i < count(); ++i) {
+            end -= sizes[i];
+            memcpy(data + end, packed.data() + from, sizes[i]);
+            store<uint16_t>(data + kHeaderSize + 2 * i, (uint16_t)end);
+            from += sizes[i];
+        }
+        store<uint16_t>(data + kCellStartOffset, (uint16_t)end);
+    }
+
+    // Adds cell as slot pos, compacting if only fragmented space is left.
+    // Returns false if the page is full.
+    bool insertCell(int pos, string_view cell) {
+        size_t need = cell.size() + 2;
+        if (cellStart() - kHeaderSize - 2 * count() < need) {
+            size_t used = 2 * count();
+            for (int i = 0; i < count(); ++i)
+                used += cellSize(i);
+            if (size - kHeaderSize - used < need) return false;
+            compact();
+        }
+        size_t start = cellStart() - cell.size();
+        memcpy(data + start, cell.data(), cell.size());
+        char *slots = data + kHeaderSize;
+        memmove(slots + 2 * (pos + 1), slots + 2 * pos, 2 * (count() - pos));
+        store<uint16_t>(slots + 2 * pos, (uint16_t)start);
+        store<uint16_t>(data + kCellStartOffset, (uint16_t)start);
+        store<uint16_t>(data + kCountOffset, (uint16_t)(count() + 1));
+        return true;
+    }
+
+    void eraseCell(int pos) {
+        char *slots = data + kHeaderSize;
+        memmove(slots + 2 * pos, slots + 2 * (pos + 1), 2 * (count() - pos - 1));
+        store<uint16_t>(data + kCountOffset, (uint16_t)(count() - 1));
+    }
+
+    void fill(const vector<string> &cells, size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i)
+            insertCell(count(), cells[i]);
+    }
+};
+
+// Index where the cells first pass half of their combined size; both sides
+// keep at least one cell.
+size_t splitPoint(const vector<string> &cells) {
+    size_t total = 0;
+    for (const string &c : cells)
+        total += c.size() + 2;
+    size_t acc = 0, mid = 0;
+    while (mid + 1 < cells.size() && acc < total / 2)
+        acc += cells[mid++].size() + 2;
+    return max<size_t>(mid, 1);
+}
+
+}
+
+// Inner pages visited on the way to a leaf and the child slot taken in each.
+struct PagedBTree::Path {
+    static const int kMaxDepth = 64;
+    uint32_t pages[kMaxDepth];
+    int slots[kMaxDepth];
+    int depth = 0;
+};
+
+PagedBTree::PagedBTree(size_t pageSize, size_t poolPages)
+    : buffers(pageSize, max(poolPages, kMinPoolPages)) {}
+
+PagedBTree::~PagedBTree() {
+    if (buffers.isOpen()) flush();
+}
+
+bool PagedBTree::open(const string &path, bool truncate) {
+    size_t pageSize = buffers.pageSize();
+    if (pageSize < kMinPageSize || pageSize > kMaxPageSize || (pageSize & (pageSize - 1))) {
+        cerr << "Page size must be a power of two from " << kMinPageSize << " to " << kMaxPageSize << " bytes.\n";
+        return false;
+    }
+    if (!buffers.open(path, truncate)) return false;
+
+    if (buffers.pageCount() == 0) {
+        uint32_t headerPage, rootPage;
+        char *header = buffers.allocate(headerPage);
+        char *leaf = header ? buffers.allocate(rootPage) : nullptr;
+        if (!leaf) return false;
+        Page{leaf, pageSize}.init(true);
+        buffers.unpin(rootPage, true);
+        buffers.unpin(headerPage, true);
+        root = rootPage;
+        records = 0;
+        return flush();
+    }
+
+    char *header = buffers.pin(0);
+    if (!header) return false;
+    bool valid = memcmp(header, kMagic, sizeof(kMagic)) == 0
+              && load<uint32_t>(header + kPageSizeOffset) == pageSize;
+    root = load<uint32_t>(header + kRootOffset);
+    records = load<uint64_t>(header + kRecordsOffset);
+    buffers.unpin(0, false);
+    if (!valid)
+        cerr << path << " is not a page file with " << pageSize << "-byte pages.\n";
+    return valid;
+}
+
+bool PagedBTree::flush() {
+    char *header = buffers.pin(0);
+    if (!header) return false;
+    memcpy(header, kMagic, sizeof(kMagic));
+    store<uint32_t>(header + kPageSizeOffset, (uint32_t)buffers.pageSize());
+    store<uint32_t>(header + kRootOffset, root);
+    store<uint64_t>(header + kRecordsOffset, records);
+    buffers.unpin(0, true);
+    return buffers.flush();
+}
+
+// Walks from the root to the leaf for key and returns it pinned. upper
+// picks the rightmost leaf that may hold key (where a new duplicate goes),
+// otherwise the leftmost (where its oldest record is).
+char *PagedBTree::descend(string_view key, bool upper, Path &path, uint32_t &leaf) {
+    path.depth = 0;
+    uint32_t id = root;
+    while (true) {
+        char *data = buffers.pin(id);
+        if (!data) return nullptr;
+        Page page{data, buffers.pageSize()};
+        if (page.leaf()) {
+            leaf = id;
+            return data;
+        }
+        int slot = upper ? page.upperBound(key) : page.lowerBound(key);
+        uint32_t child = page.child(slot);
+        buffers.unpin(id, false);
+        if (path.depth == Path::kMaxDepth) {
+            cerr << "Paged BTree is deeper than " << Path::kMaxDepth << " levels.\n";
+            return nullptr;
+        }
+        path.pages[path.depth] = id;
+        path.slots[path.depth] = slot;
+        ++path.depth;
+        id = child;
+    }
+}
+
+char *PagedBTree::findFirst(string_view key, uint32_t &page, int &slot) {
+    Path path;
+    char *data = descend(key, false, path, page);
+    // Emptied leaves and a duplicate run ending at a separator can leave the
+    // first candidate past the end of this leaf, so follow the sibling links.
+    while (data) {
+        Page leaf{data, buffers.pageSize()};
+        slot = leaf.lowerBound(key);
+        if (slot < leaf.count()) {
+            if (leaf.key(slot) == key) return data;
+            break;
+        }
+        uint32_t next = leaf.next();
+        buffers.unpin(page, false);
+        data = nullptr;
+        if (next == 0) return nullptr;
+        page = next;
+        data = buffers.pin(page);
+    }
+    if (data) buffers.unpin(page, false);
+    return nullptr;
+}
+
+// Links right in after the child last taken at the bottom of path, splitting
+// inner pages upward while they overflow.
+bool PagedBTree::insertSeparator(Path &path, string separator, uint32_t right) {
+    size_t pageSize = buffers.pageSize();
+    while (path.depth > 0) {
+        --path.depth;
+        uint32_t id = path.pages[path.depth];
+        int slot = path.slots[path.depth];
+        char *data = buffers.pin(id);
+        if (!data) return false;
+        Page page{data, pageSize};
+        string cell = innerCell(separator, right);
+        if (page.insertCell(slot, cell)) {
+            buffers.unpin(id, true);
+            return true;
+        }
+
+        vector<string> cells;
+        for (int i = 0; i < page.count(); ++i)
+            cells.push_back(page.cellBytes(i));
+        cells.insert(cells.begin() + slot, std::move(cell));
+        size_t mid = splitPoint(cells);
+        // The middle separator moves up; its child becomes the new page's
+        // leftmost.
+        const string &up = cells[mid];
+        uint32_t upChild = load<uint32_t>(up.data() + 2);
+        string upKey = up.substr(6);
+
+        uint32_t sibling;
+        char *siblingData = buffers.allocate(sibling);
+        if (!siblingData) {
+            buffers.unpin(id, false);
+            return false;
+        }
+        Page rightPage{siblingData, pageSize};
+        rightPage.init(false);
+        rightPage.setLeftmost(upChild);
+        rightPage.fill(cells, mid + 1, cells.size());
+        uint32_t leftmost = page.leftmost();
+        page.init(false);
+        page.setLeftmost(leftmost);
+        page.fill(cells, 0, mid);
+        buffers.unpin(sibling, true);
+        buffers.unpin(id, true);
+
+        separator = std::move(upKey);
+        right = sibling;
+    }
+
+    uint32_t newRoot;
+    char *data = buffers.allocate(newRoot);
+    if (!data) return false;
+    Page page{data, pageSize};
+    page.init(false);
+    page.setLeftmost(root);
+    page.insertCell(0, innerCell(separator, right));
+    buffers.unpin(newRoot, true);
+    root = newRoot;
+    return true;
+}
+
+bool PagedBTree::insert(const string &key, const Record &value) {
+    size_t usable = buffers.pageSize() - kHeaderSize;
+    string cell = leafCell(key, value);
+    // A quarter page per entry keeps every split able to place all cells.
+    if (cell.size() + 2 > usable / 4 || key.size() + 8 > usable / 8) {
+        cerr << "Entry for key " << key << " is too large for " << buffers.pageSize() << "-byte pages.\n";
+        return false;
+    }
+
+    Path path;
+    uint32_t id;
+    char *data = descend(key, true, path, id);
+    if (!data) return false;
+    Page leaf{data, buffers.pageSize()};
+    int pos = leaf.upperBound(key);
+    if (leaf.insertCell(pos, cell)) {
+        buffers.unpin(id, true);
+        ++records;
+        return true;
+    }
+
+    vector<string> cells;
+    for (int i = 0; i < leaf.count(); ++i)
+        cells.push_back(leaf.cellBytes(i));
+    cells.insert(cells.begin() + pos, std::move(cell));
+    size_t mid = splitPoint(cells);
+
+    uint32_t sibling;
+    char *siblingData = buffers.allocate(sibling);
+    if (!siblingData) {
+        buffers.unpin(id, false);
+        return false;
+    }
+    Page right{siblingData, buffers.pageSize()};
+    right.init(true);
+    right.fill(cells, mid, cells.size());
+    right.setNext(leaf.next());
+    leaf.init(true);
+    leaf.fill(cells, 0, mid);
+    leaf.setNext(sibling);
+    // The left half's largest key separates the halves; equal keys may sit
+    // on both sides of it.
+    string separator(leaf.key(leaf.count() - 1));
+    buffers.unpin(sibling, true);
+    buffers.unpin(id, true);
+    ++records;
+    return insertSeparator(path, std::move(separator), sibling);
+}
+
+optional<Record> PagedBTree::search(string_view key) {
+    uint32_t page;
+    int slot;
+    char *data = findFirst(key, page, slot);
+    if (!data) return nullopt;
+    string_view bytes = Page{data, buffers.pageSize()}.value(slot);
+    Record r;
+    bool ok = decodeRecord(bytes.data(), bytes.size(), r);
+    buffers.unpin(page, false);
+    if (!ok) return nullopt;
+    return r;
+}
+
+void PagedBTree::remove(string_view key) {
+    uint32_t page;
+    int slot;
+    char *data = findFirst(key, page, slot);
+    if (!data) {
+        cout << "The key " << key << " is not present in the tree.\n";
+        return;
+    }
+    Page{data, buffers.pageSize()}.eraseCell(slot);
+    buffers.unpin(page, true);
+    --records;
+}
+
+vector<pair<string, Record>> PagedBTree::searchPrefix(const string &prefix) {
+    vector<pair<string, Record>> results;
+    Path path;
+    uint32_t id;
+    char *data = descend(prefix, false, path, id);
+    while (data) {
+        Page leaf{data, buffers.pageSize()};
+        for (int i = leaf.lowerBound(prefix); i < leaf.count(); ++i) {
+            string_view key = leaf.key(i);
+            if (key.substr(0, prefix.size()) != prefix) {
+                buffers.unpin(id, false);
+                return results;
+            }
+            Record r;
+            string_view bytes = leaf.value(i);
+            if (decodeRecord(bytes.data(), bytes.size(), r))
+                results.push_back({string(key), std::move(r)});
+        }
+        uint32_t next = leaf.next();
+        buffers.unpin(id, false);
+        if (next == 0) break;
+        id = next;
+        data = buffers.pin(id);
+    }
+    return results;
+}
@@ -0,0 +1,64 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef PAGEDBTREE_H
+#define PAGEDBTREE_H
+
+#include "BufferPool.h"
+#include "Record.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// B+tree stored in a file of fixed-size pages (4 KiB or 16 KiB) and reached
+// only through a BufferPool, so the tree can be far larger than memory and
+// survives a restart. Page 0 holds the root id and record count. Every other
+// page is slotted: a header, an array of 2-byte cell offsets growing up from
+// it and variable-length cells packed down from the end of the page. Leaf
+// cells hold a key and its encoded record; inner cells hold a separator and
+// the page id of the child to its right.
+//
+// Duplicate keys are kept as separate cells, oldest first, and may straddle
+// leaves: child i holds keys in [keys[i - 1], keys[i]]. Pages are not merged
+// on delete; emptied leaves stay linked and lookups step over them.
+class PagedBTree {
+public:
+    PagedBTree(size_t pageSize, size_t poolPages);
+    ~PagedBTree();
+    PagedBTree(const PagedBTree&) = delete;
+    PagedBTree& operator=(const PagedBTree&) = delete;
+
+    // Opens the page file, creating it if missing or when truncate is set.
+    bool open(const string& path, bool truncate = false);
+    // Returns false if the entry cannot fit in a page or on an I/O error.
+    bool insert(const string& key, const Record& value);
+    // Oldest record stored under key.
+    optional<Record> search(string_view key);
+    // Removes the oldest record stored under key.
+    void remove(string_view key);
+    vector<pair<string, Record>> searchPrefix(const string& prefix);
+    // Writes the header and every dirty page back to the file.
+    bool flush();
+
+    size_t size() const { return records; }
+    BufferPool& pool() { return buffers; }
+
+private:
+    struct Path;
+
+    BufferPool buffers;
+    uint32_t root = 0;
+    uint64_t records = 0;
+
+    char* descend(string_view key, bool upper, Path& path, uint32_t& leaf);
+    bool insertSeparator(Path& path, string separator, uint32_t right);
+    // Pins the leaf holding the oldest record under key, if any, and sets
+    // slot to its cell; the caller unpins it.
+    char* findFirst(string_view key, uint32_t& page, int& slot);
+};
+
+#endif
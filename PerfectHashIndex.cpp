@@ -0,0 +1,255 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "PerfectHashIndex.h"
+#include "RecordIO.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+using namespace std;
+
+namespace {
+
+const char kMagic[8] = {'B', 'D', 'X', 'M', 'P', 'H', '0', '1'};
+// A slot holds at least two string lengths and a record's 16 numbers.
+const uint64_t kMinSlotBytes = 2 * sizeof(uint32_t) + 16 * 4;
+const double kKeysPerBucket = 4.0;
+const uint64_t kMaxPilot = 1ull << 24;  // give up on a seed after this many tries
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+}
+
+PerfectHashIndex::PerfectHashIndex() : seed(0), numBuckets(0), pilotBits(0) {}
+
+// Mixes the key eight bytes at a time, then applies a murmur finalizer.
+uint64_t PerfectHashIndex::hashKey(string_view key, uint64_t seed) {
+    const uint64_t kMul = 0x9e3779b97f4a7c15ull;
+    uint64_t hash = seed ^ (key.size() * kMul);
+    size_t i = 0;
+    for (; i + 8 <= key.size(); i += 8) {
+        uint64_t word;
+        memcpy(&word, key.data() + i, 8);
+        hash = (hash ^ word) * kMul;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    for (; i < key.size(); ++i)
+        tail = (tail << 8) | (unsigned char)key[i];
+    hash = (hash ^ tail) * kMul;
+    return mix64(hash);
+}
+
+// Both ranges are reduced with a multiply-shift instead of a 64-bit modulo,
+// which would otherwise dominate the lookup cost.
+uint64_t PerfectHashIndex::bucketOf(uint64_t hash) const {
+    return ((hash >> 32) * numBuckets) >> 32;
+}
+
+uint64_t PerfectHashIndex::slotOf(uint64_t hash, uint64_t pilot) const {
+    return ((mix64(hash ^ (pilot * 0x9e3779b97f4a7c15ull)) >> 32) * slots.size()) >> 32;
+}
+
+uint64_t PerfectHashIndex::pilotAt(uint64_t bucket) const {
+    if (pilotBits == 0) return 0;
+    uint64_t bit = bucket * pilotBits;
+    uint64_t word = bit / 64, shift = bit % 64;
+    uint64_t value = pilots[word] >> shift;
+    if (shift + pilotBits > 64)
+        value |= pilots[word + 1] << (64 - shift);
+    return value & ((pilotBits == 64 ? 0 : (1ull << pilotBits)) - 1);
+}
+
+// Places buckets largest first, searching each one's pilot until all of its
+// keys land on distinct free slots. Fails if some bucket needs more than
+// kMaxPilot attempts, in which case the caller retries with another seed.
+bool PerfectHashIndex::tryBuild(const vector<uint64_t> &hashes, vector<uint64_t> &pilotValues, vector<uint32_t> &slotOwner) {
+    const size_t n = hashes.size();
+    vector<vector<uint32_t>> buckets(numBuckets);
+    for (uint32_t i = 0; i < n; ++i)
+        buckets[bucketOf(hashes[i])].push_back(i);
+
+    vector<uint32_t> order(numBuckets);
+    for (uint32_t b = 0; b < numBuckets; ++b) order[b] = b;
+    stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    const uint32_t kFree = UINT32_MAX;
+    slotOwner.assign(n, kFree);
+    pilotValues.assign(numBuckets, 0);
+    vector<uint64_t> positions;
+
+    for (uint32_t b : order) {
+        const vector<uint32_t> &members = buckets[b];
+        if (members.empty()) break;
+
+        uint64_t pilot = 0;
+        for (; pilot < kMaxPilot; ++pilot) {
+            positions.clear();
+            bool ok = true;
+            for (uint32_t key : members) {
+                uint64_t pos = slotOf(hashes[key], pilot);
+                if (slotOwner[pos] != kFree || find(positions.begin(), positions.end(), pos) != positions.end()) {
+                    ok = false;
+                    break;
+                }
+                positions.push_back(pos);
+            }
+            if (ok) break;
+        }
+        if (pilot == kMaxPilot) return false;
+
+        pilotValues[b] = pilot;
+        for (size_t i = 0; i < members.size(); ++i)
+            slotOwner[positions[i]] = members[i];
+    }
+    return true;
+}
+
+void PerfectHashIndex::build(vector<pair<string, Record>> entries) {
+    // Keep only the first entry of each key.
+    vector<bool> keep(entries.size());
+    {
+        unordered_set<string_view> seen;
+        seen.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            keep[i] = seen.insert(entries[i].first).second;
+    }
+    vector<pair<string, Record>> unique;
+    unique.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (keep[i])
+            unique.push_back(std::move(entries[i]));
+    }
+
+    const size_t n = unique.size();
+    slots.clear();
+    slots.resize(n);
+    pilots.clear();
+    pilotBits = 0;
+    numBuckets = max<uint64_t>(1, (uint64_t)(n / kKeysPerBucket) + 1);
+    if (n == 0) return;
+
+    vector<uint64_t> hashes(n), pilotValues;
+    vector<uint32_t> slotOwner;
+    for (uint64_t attempt = 0;; ++attempt) {
+        seed = mix64(attempt + 1);
+        for (size_t i = 0; i < n; ++i)
+            hashes[i] = hashKey(unique[i].first, seed);
+        if (tryBuild(hashes, pilotValues, slotOwner)) break;
+    }
+
+    for (size_t pos = 0; pos < n; ++pos)
+        slots[pos] = std::move(unique[slotOwner[pos]]);
+
+    // Pack the pilots at the narrowest width that holds the largest one.
+    uint64_t maxPilot = *max_element(pilotValues.begin(), pilotValues.end());
+    pilotBits = (int)bit_width(maxPilot);
+    pilots.assign((numBuckets * pilotBits + 63) / 64 + 1, 0);
+    for (uint64_t b = 0; b < numBuckets && pilotBits > 0; ++b) {
+        uint64_t bit = b * pilotBits;
+        uint64_t word = bit / 64, shift = bit % 64;
+        pilots[word] |= pilotValues[b] << shift;
+        if (shift + pilotBits > 64)
+            pilots[word + 1] |= pilotValues[b] >> (64 - shift);
+    }
+}
+
+const Record* PerfectHashIndex::search(string_view key) const {
+    if (slots.empty()) return nullptr;
+    uint64_t hash = hashKey(key, seed);
+    const auto &entry = slots[slotOf(hash, pilotAt(bucketOf(hash)))];
+    return entry.first == key ? &entry.second : nullptr;
+}
+
+size_t PerfectHashIndex::size() const {
+    return slots.size();
+}
+
+double PerfectHashIndex::bitsPerKey() const {
+    if (slots.empty()) return 0.0;
+    return (double)(numBuckets * pilotBits) / slots.size();
+}
+
+// Layout: magic, seed, bucket count, pilot width, pilot words, slot count,
+// then every slot's key and record in slot order.
+bool PerfectHashIndex::save(const string &path) const {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out.is_open()) {
+        cerr << "Error: could not open " << path << " for writing" << endl;
+        return false;
+    }
+    out.write(kMagic, sizeof(kMagic));
+    writePod(out, seed);
+    writePod(out, numBuckets);
+    writePod(out, (uint32_t)pilotBits);
+    writePod(out, (uint64_t)pilots.size());
+    out.write(reinterpret_cast<const char *>(pilots.data()), pilots.size() * sizeof(uint64_t));
+    writePod(out, (uint64_t)slots.size());
+    for (const auto &entry : slots) {
+        writeString(out, entry.first);
+        writeRecord(out, entry.second);
+    }
+    return (bool)out;
+}
+
+bool PerfectHashIndex::load(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) {
+        cerr << "Error: could not open " << path << endl;
+        return false;
+    }
+
+    // Everything is read into locals, so a failed load leaves the index as
+    // it was.
+    char magic[sizeof(kMagic)];
+    uint64_t newSeed, newBuckets;
+    uint32_t bits;
+    uint64_t pilotWords, slotCount;
+    if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), kMagic)
+        || !readPod(in, newSeed) || !readPod(in, newBuckets) || !readPod(in, bits) || bits > 64
+        || !readPod(in, pilotWords)) {
+        cerr << "Error: " << path << " is not a perfect-hash snapshot" << endl;
+        return false;
+    }
+    if (pilotWords > remainingBytes(in) / sizeof(uint64_t)) {
+        cerr << "Error: truncated perfect-hash snapshot " << path << endl;
+        return false;
+    }
+    vector<uint64_t> newPilots(pilotWords);
+    in.read(reinterpret_cast<char *>(newPilots.data()), pilotWords * sizeof(uint64_t));
+    if (!in || !readPod(in, slotCount) || slotCount > remainingBytes(in) / kMinSlotBytes) {
+        cerr << "Error: truncated perfect-hash snapshot " << path << endl;
+        return false;
+    }
+    if (slotCount > 0 && (newBuckets == 0 || pilotWords < (newBuckets * bits + 63) / 64 + 1)) {
+        cerr << "Error: corrupt perfect-hash snapshot " << path << endl;
+        return false;
+    }
+
+    vector<pair<string, Record>> newSlots(slotCount);
+    for (auto &entry : newSlots) {
+        if (!readString(in, entry.first) || !readRecord(in, entry.second)) {
+            cerr << "Error: truncated perfect-hash snapshot " << path << endl;
+            return false;
+        }
+    }
+    seed = newSeed;
+    numBuckets = newBuckets;
+    pilotBits = (int)bits;
+    pilots = std::move(newPilots);
+    slots = std::move(newSlots);
+    return true;
+}
@@ -0,0 +1,46 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef PERFECTHASHINDEX_H
+#define PERFECTHASHINDEX_H
+
+#include "Record.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Read-only snapshot of a key set behind a minimal perfect hash (PTHash/CHD
+// style). Keys are split into buckets of about four; each bucket stores a
+// small "pilot" that, mixed into the key hash, sends every key of the bucket
+// to its own free slot in [0, n). A lookup is one hash, one pilot read and one
+// key compare to reject keys that were never in the set.
+class PerfectHashIndex {
+private:
+    uint64_t seed;
+    uint64_t numBuckets;
+    int pilotBits;
+    vector<uint64_t> pilots;             // numBuckets values, pilotBits each
+    vector<pair<string, Record>> slots;  // entry owning each hash slot
+
+    static uint64_t hashKey(string_view key, uint64_t seed);
+    uint64_t bucketOf(uint64_t hash) const;
+    uint64_t slotOf(uint64_t hash, uint64_t pilot) const;
+    uint64_t pilotAt(uint64_t bucket) const;
+    bool tryBuild(const vector<uint64_t> &hashes, vector<uint64_t> &pilotValues, vector<uint32_t> &slotOwner);
+
+public:
+    PerfectHashIndex();
+    // Takes ownership of the entries; later duplicates of a key are dropped,
+    // matching HashMap::search which returns the first one in its chain.
+    void build(vector<pair<string, Record>> entries);
+    const Record* search(string_view key) const;
+    size_t size() const;
+    double bitsPerKey() const;
+    bool save(const string &path) const;
+    bool load(const string &path);
+};
+
+#endif
@@ -0,0 +1,296 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "PersistentBTree.h"
+#include <algorithm>
+#include <atomic>
+using namespace std;
+
+namespace {
+
+atomic<size_t> nodeCount{0};
+
+}
+
+// Posting lists are shared between versions too, so copying a leaf costs
+// one reference per key rather than a copy of every record.
+struct PersistentBTree::Node {
+    bool leaf;
+    vector<string> keys;
+    vector<shared_ptr<const vector<Record>>> values;
+    vector<NodePtr> children;
+
+    explicit Node(bool isLeaf) : leaf(isLeaf) { ++nodeCount; }
+    Node(const Node& other)
+        : leaf(other.leaf), keys(other.keys), values(other.values), children(other.children) { ++nodeCount; }
+    ~Node() { --nodeCount; }
+
+    // Index of the child whose range holds key.
+    int childFor(string_view key) const {
+        return (int)(upper_bound(keys.begin(), keys.end(), key) - keys.begin());
+    }
+    int findKey(string_view key) const {
+        return (int)(lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+    }
+};
+
+namespace {
+
+using Node = PersistentBTree::Node;
+using NodePtr = PersistentBTree::NodePtr;
+using MutableNode = shared_ptr<Node>;
+
+// Right half of a node that overflowed, and the key that separates it.
+struct Split {
+    MutableNode right;
+    string separator;
+};
+
+// Splits an overflowing fresh node in place, B+tree style: a leaf keeps its
+// separator as the right half's first key, an inner node moves it up.
+Split splitNode(Node& node) {
+    int mid = (int)node.keys.size() / 2;
+    Split split{make_shared<Node>(node.leaf), node.keys[mid]};
+    Node& right = *split.right;
+    int firstRight = node.leaf ? mid : mid + 1;
+    right.keys.assign(node.keys.begin() + firstRight, node.keys.end());
+    node.keys.resize(mid);
+    if (node.leaf) {
+        right.values.assign(node.values.begin() + mid, node.values.end());
+        node.values.resize(mid);
+    } else {
+        right.children.assign(node.children.begin() + mid + 1, node.children.end());
+        node.children.resize(mid + 1);
+    }
+    return split;
+}
+
+// Returns a fresh copy of node with record added under key. If the copy
+// overflows, its right half is returned through split.
+MutableNode insertInto(const Node& node, const string& key, const Record& record, int maxKeys, Split& split) {
+    MutableNode copy = make_shared<Node>(node);
+    if (copy->leaf) {
+        int pos = copy->findKey(key);
+        if (pos < (int)copy->keys.size() && copy->keys[pos] == key) {
+            auto postings = make_shared<vector<Record>>(*copy->values[pos]);
+            postings->push_back(record);
+            copy->values[pos] = std::move(postings);
+            return copy;
+        }
+        copy->keys.insert(copy->keys.begin() + pos, key);
+        copy->values.insert(copy->values.begin() + pos, make_shared<const vector<Record>>(1, record));
+    } else {
+        int i = copy->childFor(key);
+        Split childSplit;
+        copy->children[i] = insertInto(*copy->children[i], key, record, maxKeys, childSplit);
+        if (childSplit.right) {
+            copy->keys.insert(copy->keys.begin() + i, std::move(childSplit.separator));
+            copy->children.insert(copy->children.begin() + i + 1, std::move(childSplit.right));
+        }
+    }
+    if ((int)copy->keys.size() > maxKeys)
+        split = splitNode(*copy);
+    return copy;
+}
+
+// Refills parent.children[i], a fresh node that fell below minKeys, from a
+// copied sibling or by merging with one. parent is fresh as well.
+void fixChild(Node& parent, int i, int minKeys) {
+    MutableNode child = const_pointer_cast<Node>(parent.children[i]);
+    int last = (int)parent.children.size() - 1;
+
+    if (i > 0 && (int)parent.children[i - 1]->keys.size() > minKeys) {
+        MutableNode left = make_shared<Node>(*parent.children[i - 1]);
+        if (child->leaf) {
+            child->keys.insert(child->keys.begin(), std::move(left->keys.back()));
+            child->values.insert(child->values.begin(), std::move(left->values.back()));
+            left->values.pop_back();
+            parent.keys[i - 1] = child->keys.front();
+        } else {
+            child->keys.insert(child->keys.begin(), std::move(parent.keys[i - 1]));
+            child->children.insert(child->children.begin(), std::move(left->children.back()));
+            left->children.pop_back();
+            parent.keys[i - 1] = std::move(left->keys.back());
+        }
+        left->keys.pop_back();
+        parent.children[i - 1] = std::move(left);
+        return;
+    }
+    if (i < last && (int)parent.children[i + 1]->keys.size() > minKeys) {
+        MutableNode right = make_shared<Node>(*parent.children[i + 1]);
+        if (child->leaf) {
+            child->keys.push_back(std::move(right->keys.front()));
+            child->values.push_back(std::move(right->values.front()));
+            right->values.erase(right->values.begin());
+            right->keys.erase(right->keys.begin());
+            parent.keys[i] = right->keys.front();
+        } else {
+            child->keys.push_back(std::move(parent.keys[i]));
+            child->children.push_back(std::move(right->children.front()));
+            right->children.erase(right->children.begin());
+            parent.keys[i] = std::move(right->keys.front());
+            right->keys.erase(right->keys.begin());
+        }
+        parent.children[i + 1] = std::move(right);
+        return;
+    }
+
+    // Merge children[j + 1] into a fresh copy of children[j].
+    int j = i > 0 ? i - 1 : i;
+    MutableNode left = j == i ? child : make_shared<Node>(*parent.children[j]);
+    const Node& right = *parent.children[j + 1];
+    if (!left->leaf)
+        left->keys.push_back(std::move(parent.keys[j]));
+    left->keys.insert(left->keys.end(), right.keys.begin(), right.keys.end());
+    left->values.insert(left->values.end(), right.values.begin(), right.values.end());
+    left->children.insert(left->children.end(), right.children.begin(), right.children.end());
+    parent.keys.erase(parent.keys.begin() + j);
+    parent.children.erase(parent.children.begin() + j + 1);
+    parent.children[j] = std::move(left);
+}
+
+// Returns a fresh copy of node without the oldest record under key (or all
+// of them), or nullptr if key is absent and nothing needs copying.
+MutableNode removeFrom(const Node& node, string_view key, bool all, int minKeys, size_t& removed) {
+    if (node.leaf) {
+        int pos = node.findKey(key);
+        if (pos == (int)node.keys.size() || node.keys[pos] != key) return nullptr;
+        MutableNode copy = make_shared<Node>(node);
+        const vector<Record>& postings = *copy->values[pos];
+        if (!all && postings.size() > 1) {
+            copy->values[pos] = make_shared<const vector<Record>>(postings.begin() + 1, postings.end());
+            removed = 1;
+        } else {
+            removed = postings.size();
+            copy->keys.erase(copy->keys.begin() + pos);
+            copy->values.erase(copy->values.begin() + pos);
+        }
+        return copy;
+    }
+    int i = node.childFor(key);
+    MutableNode child = removeFrom(*node.children[i], key, all, minKeys, removed);
+    if (!child) return nullptr;
+    MutableNode copy = make_shared<Node>(node);
+    bool underflow = (int)child->keys.size() < minKeys;
+    copy->children[i] = std::move(child);
+    if (underflow)
+        fixChild(*copy, i, minKeys);
+    return copy;
+}
+
+void visitAll(const Node& node, const function<void(const string&, const Record&)>& visit) {
+    if (node.leaf) {
+        for (size_t i = 0; i < node.keys.size(); ++i)
+            for (const Record& r : *node.values[i])
+                visit(node.keys[i], r);
+        return;
+    }
+    for (const NodePtr& child : node.children)
+        visitAll(*child, visit);
+}
+
+size_t visitRange(const Node& node, string_view lo, string_view hi,
+                  const function<void(const string&, const Record&)>& visit) {
+    size_t visited = 0;
+    if (node.leaf) {
+        for (int i = node.findKey(lo); i < (int)node.keys.size() && node.keys[i] < hi; ++i) {
+            for (const Record& r : *node.values[i])
+                visit(node.keys[i], r);
+            visited += node.values[i]->size();
+        }
+        return visited;
+    }
+    // Children wholly below lo or at or above hi are skipped.
+    int first = node.childFor(lo);
+    int end = (int)(lower_bound(node.keys.begin(), node.keys.end(), hi) - node.keys.begin());
+    for (int i = first; i <= end; ++i)
+        visited += visitRange(*node.children[i], lo, hi, visit);
+    return visited;
+}
+
+}
+
+const Record* PersistentBTree::Snapshot::search(string_view key) const {
+    span<const Record> all = searchAll(key);
+    return all.empty() ? nullptr : &all.front();
+}
+
+span<const Record> PersistentBTree::Snapshot::searchAll(string_view key) const {
+    if (!root) return {};
+    const Node* node = root.get();
+    while (!node->leaf)
+        node = node->children[node->childFor(key)].get();
+    int pos = node->findKey(key);
+    if (pos == (int)node->keys.size() || node->keys[pos] != key) return {};
+    return *node->values[pos];
+}
+
+void PersistentBTree::Snapshot::forEach(const function<void(const string&, const Record&)>& visit) const {
+    if (root) visitAll(*root, visit);
+}
+
+size_t PersistentBTree::Snapshot::rangeScan(string_view lo, string_view hi,
+                                            const function<void(const string&, const Record&)>& visit) const {
+    if (!root || !(lo < hi)) return 0;
+    return visitRange(*root, lo, hi, visit);
+}
+
+PersistentBTree::PersistentBTree(int t) : t(max(2, t)) {
+    current.root = make_shared<const Node>(true);
+}
+
+PersistentBTree::Snapshot PersistentBTree::snapshot() const {
+    lock_guard<mutex> guard(rootLock);
+    return current;
+}
+
+size_t PersistentBTree::liveNodes() {
+    return nodeCount.load();
+}
+
+// Only writers call this, under writeLock, so reading current outside
+// rootLock is safe; readers are excluded just for the swap itself.
+void PersistentBTree::publish(NodePtr root, size_t count) {
+    Snapshot next;
+    next.root = std::move(root);
+    next.count = count;
+    next.ver = current.ver + 1;
+    lock_guard<mutex> guard(rootLock);
+    swap(current, next);
+}
+
+void PersistentBTree::insert(const string& key, const Record& record) {
+    lock_guard<mutex> guard(writeLock);
+    Split split;
+    NodePtr root = insertInto(*current.root, key, record, 2 * t - 1, split);
+    if (split.right) {
+        auto grown = make_shared<Node>(false);
+        grown->keys.push_back(std::move(split.separator));
+        grown->children.push_back(std::move(root));
+        grown->children.push_back(std::move(split.right));
+        root = std::move(grown);
+    }
+    publish(std::move(root), current.count + 1);
+}
+
+bool PersistentBTree::remove(string_view key) {
+    return removeRecords(key, false) > 0;
+}
+
+size_t PersistentBTree::removeAll(string_view key) {
+    return removeRecords(key, true);
+}
+
+size_t PersistentBTree::removeRecords(string_view key, bool all) {
+    lock_guard<mutex> guard(writeLock);
+    size_t removed = 0;
+    MutableNode root = removeFrom(*current.root, key, all, t - 1, removed);
+    if (!root) return 0;
+    // An inner root left with a single child hands the root to it.
+    NodePtr next = root;
+    if (!root->leaf && root->keys.empty())
+        next = root->children.front();
+    publish(std::move(next), current.count - removed);
+    return removed;
+}
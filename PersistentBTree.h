@@ -0,0 +1,83 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef PERSISTENTBTREE_H
+#define PERSISTENTBTREE_H
+
+#include "Record.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Copy-on-write B+tree. Nodes are immutable once published: a mutation
+// copies only the nodes on the path from the root to the leaf it changes
+// (plus a sibling when rebalancing) and publishes a new root that shares
+// every other node with the previous version. A Snapshot holds one root, so
+// taking one is a pointer copy and it stays consistent for as long as the
+// reader keeps it, however many writes follow. Versions are reclaimed by
+// reference counting once the tree and every snapshot have moved past them.
+//
+// Separators follow BTree: children[i] < keys[i] <= children[i + 1]. Keys are
+// stored once with a posting list of records, oldest first. Leaves are not
+// linked, since a link would force every neighbour onto the copied path.
+class PersistentBTree {
+public:
+    struct Node;
+    using NodePtr = shared_ptr<const Node>;
+
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        // Oldest record stored under key, or nullptr.
+        const Record* search(string_view key) const;
+        // Every record stored under key, oldest first; valid while the
+        // snapshot is alive.
+        span<const Record> searchAll(string_view key) const;
+        void forEach(const function<void(const string&, const Record&)>& visit) const;
+        // Visits keys in [lo, hi) in order and returns the records visited.
+        size_t rangeScan(string_view lo, string_view hi,
+                         const function<void(const string&, const Record&)>& visit) const;
+        size_t size() const { return count; }
+        // Number of writes applied before this snapshot was taken.
+        uint64_t version() const { return ver; }
+
+    private:
+        friend class PersistentBTree;
+        NodePtr root;
+        size_t count = 0;
+        uint64_t ver = 0;
+    };
+
+    explicit PersistentBTree(int t);
+    PersistentBTree(const PersistentBTree&) = delete;
+    PersistentBTree& operator=(const PersistentBTree&) = delete;
+
+    // Writers are serialised with each other; readers never wait for them
+    // beyond the pointer copy in snapshot().
+    void insert(const string& key, const Record& record);
+    // Removes the oldest record under key. Returns false if key is absent.
+    bool remove(string_view key);
+    size_t removeAll(string_view key);
+    Snapshot snapshot() const;
+
+    // Nodes currently allocated across all trees and versions.
+    static size_t liveNodes();
+
+private:
+    int t;
+    mutex writeLock;
+    mutable mutex rootLock;
+    Snapshot current;
+
+    void publish(NodePtr root, size_t count);
+    size_t removeRecords(string_view key, bool all);
+};
+
+#endif
@@ -0,0 +1,24 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#endif
+
+// Hint the CPU to start pulling a cache line in for reading. Used by the
+// batched lookups to overlap the memory latency of several searches.
+inline void prefetchRead(const void *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#elif defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+#endif
@@ -0,0 +1,126 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "RecordIO.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+void writeString(ostream &out, const string &s) {
+    writePod(out, (uint32_t)s.size());
+    out.write(s.data(), s.size());
+}
+
+// The string grows only as its bytes arrive, so a corrupt length fails at the
+// end of the file instead of allocating up to 4 GiB first.
+bool readString(istream &in, string &s) {
+    const uint32_t kChunk = 1 << 16;
+    uint32_t len;
+    if (!readPod(in, len)) return false;
+    s.clear();
+    while (s.size() < len) {
+        size_t at = s.size();
+        size_t n = min<size_t>(kChunk, len - at);
+        s.resize(at + n);
+        if (!in.read(s.data() + at, n)) return false;
+    }
+    return true;
+}
+
+uint64_t remainingBytes(istream &in) {
+    istream::pos_type pos = in.tellg();
+    if (pos < 0) return 0;
+    in.seekg(0, ios::end);
+    istream::pos_type end = in.tellg();
+    in.seekg(pos);
+    return end > pos ? (uint64_t)(end - pos) : 0;
+}
+
+void writeRecord(ostream &out, const Record &r) {
+    writeString(out, r.state);
+    writePod(out, r.year);
+    writePod(out, r.dhsDenominator);
+    writePod(out, r.numberOfFirms);
+    writePod(out, r.netJobCreation);
+    writePod(out, r.netJobCreationRate);
+    writePod(out, r.reallocationRate);
+    writePod(out, r.establishmentsEntered);
+    writePod(out, r.enteredRate);
+    writePod(out, r.establishmentsExited);
+    writePod(out, r.exitedRate);
+    writePod(out, r.physicalLocations);
+    writePod(out, r.firmExits);
+    writePod(out, r.jobCreation);
+    writePod(out, r.jobCreationRate);
+    writePod(out, r.jobDestruction);
+    writePod(out, r.jobDestructionRate);
+}
+
+bool readRecord(istream &in, Record &r) {
+    return readString(in, r.state)
+        && readPod(in, r.year)
+        && readPod(in, r.dhsDenominator)
+        && readPod(in, r.numberOfFirms)
+        && readPod(in, r.netJobCreation)
+        && readPod(in, r.netJobCreationRate)
+        && readPod(in, r.reallocationRate)
+        && readPod(in, r.establishmentsEntered)
+        && readPod(in, r.enteredRate)
+        && readPod(in, r.establishmentsExited)
+        && readPod(in, r.exitedRate)
+        && readPod(in, r.physicalLocations)
+        && readPod(in, r.firmExits)
+        && readPod(in, r.jobCreation)
+        && readPod(in, r.jobCreationRate)
+        && readPod(in, r.jobDestruction)
+        && readPod(in, r.jobDestructionRate);
+}
+
+namespace {
+
+// Numeric fields in writeRecord order; every one of them is 4 bytes.
+template <class R, class Fn>
+void forEachNumber(R &r, Fn fn) {
+    fn(r.year); fn(r.dhsDenominator); fn(r.numberOfFirms); fn(r.netJobCreation);
+    fn(r.netJobCreationRate); fn(r.reallocationRate); fn(r.establishmentsEntered);
+    fn(r.enteredRate); fn(r.establishmentsExited); fn(r.exitedRate);
+    fn(r.physicalLocations); fn(r.firmExits); fn(r.jobCreation);
+    fn(r.jobCreationRate); fn(r.jobDestruction); fn(r.jobDestructionRate);
+}
+
+const size_t kNumberBytes = 16 * 4;
+
+}
+
+size_t encodedRecordSize(const Record &r) {
+    return sizeof(uint32_t) + r.state.size() + kNumberBytes;
+}
+
+char *encodeRecord(char *out, const Record &r) {
+    uint32_t len = (uint32_t)r.state.size();
+    memcpy(out, &len, sizeof(len));
+    out += sizeof(len);
+    memcpy(out, r.state.data(), len);
+    out += len;
+    forEachNumber(r, [&](const auto &field) {
+        memcpy(out, &field, sizeof(field));
+        out += sizeof(field);
+    });
+    return out;
+}
+
+bool decodeRecord(const char *data, size_t size, Record &r) {
+    uint32_t len;
+    if (size < sizeof(len)) return false;
+    memcpy(&len, data, sizeof(len));
+    if (size != sizeof(len) + len + kNumberBytes) return false;
+    r.state.assign(data + sizeof(len), len);
+    data += sizeof(len) + len;
+    forEachNumber(r, [&](auto &field) {
+        memcpy(&field, data, sizeof(field));
+        data += sizeof(field);
+    });
+    return true;
+}
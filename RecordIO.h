@@ -0,0 +1,39 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef RECORDIO_H
+#define RECORDIO_H
+
+#include "Record.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+using namespace std;
+
+// Binary encoding shared by the on-disk snapshot formats. Numbers are written
+// in host byte order, so files are meant to be read back on the same machine.
+void writeString(ostream &out, const string &s);
+bool readString(istream &in, string &s);
+void writeRecord(ostream &out, const Record &r);
+bool readRecord(istream &in, Record &r);
+// Bytes between the read position and the end of a seekable stream, for
+// checking counts read from a file before allocating for them.
+uint64_t remainingBytes(istream &in);
+// Same layout into and out of a memory buffer, for page-based storage.
+size_t encodedRecordSize(const Record &r);
+char *encodeRecord(char *out, const Record &r);
+bool decodeRecord(const char *data, size_t size, Record &r);
+
+template <class T>
+void writePod(ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+bool readPod(istream &in, T &value) {
+    return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+#endif
@@ -0,0 +1,149 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "ReportWriter.h"
+#include <charconv>
+#include <iostream>
+using namespace std;
+
+namespace {
+
+const size_t kBufferSize = 1 << 18;
+
+}
+
+ReportWriter::ReportWriter(const ReportOptions &opts, bool paged)
+    : out(&cout), options(opts), rowsSeen(0), rowsWritten(0) {
+    if (!paged) {
+        options.limit = SIZE_MAX;
+        options.offset = 0;
+    }
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath, ios::binary | ios::trunc);
+        if (!file.is_open())
+            cerr << "Error: could not open " << options.outputPath << " for writing" << endl;
+        out = &file;
+    }
+    buffer.reserve(kBufferSize + 1024);
+}
+
+ReportWriter::~ReportWriter() {
+    flush();
+}
+
+bool ReportWriter::isOpen() const {
+    return out != &file || file.is_open();
+}
+
+bool ReportWriter::toFile() const {
+    return out == &file;
+}
+
+const string& ReportWriter::path() const {
+    return options.outputPath;
+}
+
+void ReportWriter::flushIfFull() {
+    if (buffer.size() >= kBufferSize)
+        flush();
+}
+
+void ReportWriter::flush() {
+    if (buffer.empty()) return;
+    out->write(buffer.data(), buffer.size());
+    out->flush();
+    buffer.clear();
+}
+
+void ReportWriter::text(string_view s) {
+    buffer.append(s);
+    flushIfFull();
+}
+
+bool ReportWriter::beginRow() {
+    size_t row = rowsSeen++;
+    return row >= options.offset && row - options.offset < options.limit;
+}
+
+bool ReportWriter::pageFull() const {
+    return rowsSeen >= options.offset && rowsSeen - options.offset >= options.limit;
+}
+
+void ReportWriter::pad(size_t used, int width) {
+    if ((int)used < width)
+        buffer.append(width - used, ' ');
+}
+
+void ReportWriter::cell(string_view value, int width) {
+    buffer.append(value);
+    pad(value.size(), width);
+}
+
+void ReportWriter::number(long long value, int width) {
+    char tmp[24];
+    char *end = to_chars(tmp, tmp + sizeof(tmp), value).ptr;
+    cell(string_view(tmp, end - tmp), width);
+}
+
+void ReportWriter::decimal(double value, int width, int precision) {
+    char tmp[64];
+    auto result = to_chars(tmp, tmp + sizeof(tmp), value, chars_format::fixed, precision);
+    cell(string_view(tmp, result.ptr - tmp), width);
+}
+
+void ReportWriter::endRow() {
+    buffer.push_back('\n');
+    rowsWritten++;
+    flushIfFull();
+}
+
+size_t ReportWriter::rowsVisited() const {
+    return rowsSeen;
+}
+
+size_t ReportWriter::rowsPrinted() const {
+    return rowsWritten;
+}
+
+void writeRecordTableHeader(ReportWriter &writer) {
+    writer.cell("State", 12);
+    writer.cell("Year", 6);
+    writer.cell("Firms", 10);
+    writer.cell("NetJob", 12);
+    writer.cell("JobRate", 10);
+    writer.cell("Realloc", 12);
+    writer.cell("Entered", 12);
+    writer.cell("EntRate", 10);
+    writer.cell("Exited", 10);
+    writer.cell("ExRate", 10);
+    writer.cell("PhysLoc", 10);
+    writer.cell("FirmEx", 10);
+    writer.cell("JobCreate", 12);
+    writer.cell("CreateR", 10);
+    writer.cell("JobDestr", 12);
+    writer.cell("DestrR", 10);
+    writer.text("\n");
+    writer.text(string(160, '-'));
+    writer.text("\n");
+}
+
+void writeRecordRow(ReportWriter &writer, const Record &r) {
+    writer.cell(r.state, 12);
+    writer.number(r.year, 6);
+    writer.number(r.numberOfFirms, 10);
+    writer.number(r.netJobCreation, 12);
+    writer.decimal(r.netJobCreationRate, 10, 2);
+    writer.decimal(r.reallocationRate, 12, 2);
+    writer.number(r.establishmentsEntered, 12);
+    writer.decimal(r.enteredRate, 10, 2);
+    writer.number(r.establishmentsExited, 10);
+    writer.decimal(r.exitedRate, 10, 2);
+    writer.number(r.physicalLocations, 10);
+    writer.number(r.firmExits, 10);
+    writer.number(r.jobCreation, 12);
+    writer.decimal(r.jobCreationRate, 10, 2);
+    writer.number(r.jobDestruction, 12);
+    writer.decimal(r.jobDestructionRate, 10, 2);
+    writer.endRow();
+}
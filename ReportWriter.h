@@ -0,0 +1,73 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef REPORTWRITER_H
+#define REPORTWRITER_H
+
+#include "Record.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Paging and destination shared by every table report (--limit, --offset,
+// --output on the command line).
+struct ReportOptions {
+    size_t limit = SIZE_MAX;  // data rows to print
+    size_t offset = 0;        // data rows to skip before printing
+    string outputPath;        // empty means standard output
+};
+
+// Formats report tables into one large reusable buffer with to_chars and
+// writes it out in big blocks, instead of pushing every cell through stream
+// manipulators and flushing every row. Cells are left-aligned and padded to
+// their width like `left << setw(width)`.
+class ReportWriter {
+private:
+    ofstream file;
+    ostream *out;
+    string buffer;
+    ReportOptions options;
+    size_t rowsSeen;
+    size_t rowsWritten;
+
+    void pad(size_t used, int width);
+    void flushIfFull();
+
+public:
+    // With paged == false every row is written regardless of limit/offset.
+    explicit ReportWriter(const ReportOptions &options, bool paged = true);
+    ~ReportWriter();
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    bool isOpen() const;
+    bool toFile() const;
+    const string& path() const;
+
+    // Free text such as titles and rules; never paged.
+    void text(string_view s);
+    // Starts the next data row. Returns false if paging skips it, in which
+    // case the caller should not format any cells for it.
+    bool beginRow();
+    // True once the page is complete, so callers can stop scanning early.
+    bool pageFull() const;
+    void cell(string_view value, int width);
+    void number(long long value, int width);
+    void decimal(double value, int width, int precision);
+    void endRow();
+    void flush();
+
+    size_t rowsVisited() const;
+    size_t rowsPrinted() const;
+};
+
+// The 16-column record table used by the full dump and per-state reports.
+void writeRecordTableHeader(ReportWriter &writer);
+void writeRecordRow(ReportWriter &writer, const Record &r);
+
+#endif
@@ -0,0 +1,145 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "SecondaryIndex.h"
+#include "Key.h"
+#include <bit>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+namespace {
+
+// Flipping the sign bit orders two's complement ints as unsigned words.
+uint32_t encodeInt(int value) {
+    return (uint32_t)value ^ 0x80000000u;
+}
+
+// Positive floats order like their bit patterns once the sign bit is set;
+// negative ones order in reverse, so all their bits are flipped.
+uint32_t encodeFloat(float value) {
+    uint32_t bits = bit_cast<uint32_t>(value);
+    return (bits & 0x80000000u) ? ~bits : bits ^ 0x80000000u;
+}
+
+uint32_t encodeValue(const NumericField& field, const Record& r) {
+    return field.intValue ? encodeInt(r.*field.intValue) : encodeFloat(r.*field.floatValue);
+}
+
+void appendBigEndian(string& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((char)(value >> shift));
+}
+
+// Encoded form of the smallest field value >= bound (lower) or the largest
+// field value <= bound; false if the field type has no such value.
+bool encodeBound(const NumericField& field, double bound, bool lower, uint32_t& out) {
+    if (field.intValue) {
+        double v = lower ? ceil(bound) : floor(bound);
+        if (lower ? v > INT_MAX : v < INT_MIN) return false;
+        out = encodeInt((int)clamp<double>(v, INT_MIN, INT_MAX));
+        return true;
+    }
+    float f = (float)clamp<double>(bound, -FLT_MAX, FLT_MAX);
+    if (lower && f < bound) {
+        if (f == FLT_MAX) return false;
+        f = nextafterf(f, INFINITY);
+    } else if (!lower && f > bound) {
+        if (f == -FLT_MAX) return false;
+        f = nextafterf(f, -INFINITY);
+    }
+    out = encodeFloat(f);
+    return true;
+}
+
+}
+
+SecondaryIndex::SecondaryIndex(const NumericField& field, int order) : indexed(&field), tree(order) {}
+
+string SecondaryIndex::entryKey(const Record& r) const {
+    YearDigits digits(r.year);
+    string key;
+    key.reserve(4 + r.state.size() + 1 + digits.len);
+    appendBigEndian(key, encodeValue(*indexed, r));
+    key.append(r.state);
+    key.push_back('_');
+    key.append(digits.view());
+    return key;
+}
+
+void SecondaryIndex::build(const BTree& primary) {
+    primary.forEach([&](const string&, const Record& r) { insert(r); });
+}
+
+void SecondaryIndex::insert(const Record& r) {
+    tree.insert(entryKey(r), r);
+}
+
+void SecondaryIndex::remove(const Record& r) {
+    string key = entryKey(r);
+    if (tree.search(key) != nullptr)
+        tree.remove(key);
+}
+
+// The low key is the bare 4-byte value, which sorts before every entry
+// holding that value. The high key appends 0xFF to the last value, which no
+// state name contains, so it sorts after every entry holding that value.
+size_t SecondaryIndex::range(double lo, double hi, const function<void(const Record&)>& visit) const {
+    uint32_t first, last;
+    if (!(lo <= hi) || !encodeBound(*indexed, lo, true, first) || !encodeBound(*indexed, hi, false, last)
+        || first > last)
+        return 0;
+    string loKey, hiKey;
+    appendBigEndian(loKey, first);
+    appendBigEndian(hiKey, last);
+    hiKey.push_back('\xff');
+    return tree.rangeScan(loKey, hiKey, [&](const string&, const Record& r) { visit(r); });
+}
+
+vector<const Record*> SecondaryIndex::smallest(size_t k) const {
+    vector<const Record*> out;
+    BTree::Cursor cursor = tree.cursor();
+    for (cursor.seekFirst(); cursor.valid() && out.size() < k; cursor.next())
+        out.push_back(&cursor.record());
+    return out;
+}
+
+vector<const Record*> SecondaryIndex::largest(size_t k) const {
+    vector<const Record*> out;
+    BTree::Cursor cursor = tree.cursor();
+    for (cursor.seekLast(); cursor.valid() && out.size() < k; cursor.prev())
+        out.push_back(&cursor.record());
+    return out;
+}
+
+size_t SecondaryIndex::countBelow(double value) const {
+    uint32_t first;
+    if (!encodeBound(*indexed, value, true, first)) return tree.size();
+    string key;
+    appendBigEndian(key, first);
+    return tree.rank(key);
+}
+
+size_t SecondaryIndex::countAtMost(double value) const {
+    uint32_t last;
+    if (!encodeBound(*indexed, value, false, last)) return 0;
+    string key;
+    appendBigEndian(key, last);
+    key.push_back('\xff');
+    return tree.rank(key);
+}
+
+double SecondaryIndex::percentileRank(double value) const {
+    size_t n = tree.size();
+    if (n == 0) return 0;
+    double below = (double)countBelow(value);
+    double equal = (double)countAtMost(value) - below;
+    return 100.0 * (below + equal / 2) / (double)n;
+}
+
+const Record* SecondaryIndex::quantile(double q) const {
+    return tree.quantile(q);
+}
@@ -0,0 +1,61 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef SECONDARYINDEX_H
+#define SECONDARYINDEX_H
+
+#include "BTree.h"
+#include "NumericField.h"
+#include "Record.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Secondary index on one numeric field, kept in a BTree whose keys are the
+// field value encoded as 4 order-preserving big-endian bytes followed by the
+// record's "State_Year" key. Keys therefore sort by value, then by primary
+// key, so a value range is one rangeScan and the k smallest or largest
+// values are the first or last k entries of the leaf chain. Each entry holds
+// a copy of its record, so queries never go back to the primary structures.
+class SecondaryIndex {
+public:
+    SecondaryIndex(const NumericField& field, int order);
+
+    const NumericField& field() const { return *indexed; }
+    size_t size() const { return tree.size(); }
+    // Indexes every record of the primary tree.
+    void build(const BTree& primary);
+    void insert(const Record& r);
+    // Drops the entry of r, which must have been inserted with the same
+    // state, year and field value.
+    void remove(const Record& r);
+    // Calls visit for every record with lo <= value <= hi, in ascending value
+    // order. Returns the number of records visited.
+    size_t range(double lo, double hi, const function<void(const Record&)>& visit) const;
+    // Up to k records with the smallest values, smallest first. The pointers
+    // stay valid until the next insert or remove.
+    vector<const Record*> smallest(size_t k) const;
+    // Up to k records with the largest values, largest first.
+    vector<const Record*> largest(size_t k) const;
+    // Records whose value is below (at most) value, from the tree's subtree
+    // counts in O(log n).
+    size_t countBelow(double value) const;
+    size_t countAtMost(double value) const;
+    // Percentile rank of value: the share of records below it, counting
+    // records equal to it as half, in [0, 100].
+    double percentileRank(double value) const;
+    // The record holding the value at quantile q in [0, 1] (nearest rank),
+    // or nullptr if the index is empty.
+    const Record* quantile(double q) const;
+
+private:
+    const NumericField* indexed;
+    BTree tree;
+
+    string entryKey(const Record& r) const;
+};
+
+#endif
@@ -0,0 +1,151 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "ShardedHashMap.h"
+#include <condition_variable>
+#include <cstdint>
+#include <latch>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+struct ShardedHashMap::Shard {
+    HashMap map;
+    mutex lock;
+    condition_variable ready;
+    vector<function<void(HashMap&)>> queue;
+    bool stopping = false;
+    thread worker;
+
+    explicit Shard(int buckets) : map(buckets) {}
+
+    // Takes the whole queue at once so the lock is held once per burst of
+    // requests rather than once per request.
+    void run() {
+        vector<function<void(HashMap&)>> batch;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                batch.swap(queue);
+            }
+            for (auto &task : batch)
+                task(map);
+            batch.clear();
+        }
+    }
+};
+
+ShardedHashMap::ShardedHashMap(int shardCount, int bucketsPerShard) {
+    if (shardCount < 1) shardCount = 1;
+    for (int i = 0; i < shardCount; ++i) {
+        shards.push_back(make_unique<Shard>(bucketsPerShard));
+        Shard *shard = shards.back().get();
+        shard->worker = thread([shard] { shard->run(); });
+    }
+}
+
+ShardedHashMap::~ShardedHashMap() {
+    for (auto &shard : shards) {
+        {
+            lock_guard<mutex> guard(shard->lock);
+            shard->stopping = true;
+        }
+        shard->ready.notify_one();
+    }
+    for (auto &shard : shards)
+        shard->worker.join();
+}
+
+int ShardedHashMap::shardCount() const {
+    return (int)shards.size();
+}
+
+// The shard comes from the high bits of the mixed key hash, while HashMap
+// picks buckets from the low bits, so the two choices stay independent.
+size_t ShardedHashMap::shardOf(string_view key) const {
+    uint64_t hash = HashMap::hashKey(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return (size_t)(((hash >> 32) * shards.size()) >> 32);
+}
+
+void ShardedHashMap::submit(size_t shard, function<void(HashMap&)> task) {
+    Shard &s = *shards[shard];
+    {
+        lock_guard<mutex> guard(s.lock);
+        s.queue.push_back(std::move(task));
+    }
+    s.ready.notify_one();
+}
+
+void ShardedHashMap::insert(const string &key, const Record &record) {
+    submit(shardOf(key), [key, record](HashMap &map) { map.insert(key, record); });
+}
+
+void ShardedHashMap::remove(string_view key) {
+    submit(shardOf(key), [key = string(key)](HashMap &map) { map.remove(key); });
+}
+
+void ShardedHashMap::insertBatch(span<const pair<string, Record>> entries) {
+    vector<vector<uint32_t>> perShard(shards.size());
+    for (uint32_t i = 0; i < entries.size(); ++i)
+        perShard[shardOf(entries[i].first)].push_back(i);
+
+    ptrdiff_t involved = 0;
+    for (const auto &indices : perShard)
+        involved += !indices.empty();
+    latch done(involved);
+
+    for (size_t s = 0; s < shards.size(); ++s) {
+        if (perShard[s].empty()) continue;
+        submit(s, [&entries, &done, indices = std::move(perShard[s])](HashMap &map) {
+            for (uint32_t i : indices)
+                map.insert(entries[i].first, entries[i].second);
+            done.count_down();
+        });
+    }
+    done.wait();
+}
+
+optional<Record> ShardedHashMap::search(string_view key) {
+    optional<Record> result;
+    searchBatch(span<const string_view>(&key, 1), span<optional<Record>>(&result, 1));
+    return result;
+}
+
+void ShardedHashMap::searchBatch(span<const string_view> keys, span<optional<Record>> out) {
+    vector<vector<uint32_t>> perShard(shards.size());
+    for (uint32_t i = 0; i < keys.size(); ++i)
+        perShard[shardOf(keys[i])].push_back(i);
+
+    ptrdiff_t involved = 0;
+    for (const auto &indices : perShard)
+        involved += !indices.empty();
+    latch done(involved);
+
+    for (size_t s = 0; s < shards.size(); ++s) {
+        if (perShard[s].empty()) continue;
+        submit(s, [keys, out, &done, indices = std::move(perShard[s])](HashMap &map) {
+            for (uint32_t i : indices) {
+                Record *found = map.search(keys[i]);
+                if (found)
+                    out[i] = *found;
+                else
+                    out[i].reset();
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+}
+
+void ShardedHashMap::flush() {
+    latch done((ptrdiff_t)shards.size());
+    for (size_t s = 0; s < shards.size(); ++s)
+        submit(s, [&done](HashMap &) { done.count_down(); });
+    done.wait();
+}
@@ -0,0 +1,51 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef SHARDEDHASHMAP_H
+#define SHARDEDHASHMAP_H
+
+#include "HashMap.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+// Partitions keys by the high bits of their hash into independent HashMap
+// shards. Each shard is owned by one worker thread that drains its own
+// request queue, so shards never share data or locks with each other.
+// Requests to one shard run in submission order, which means a search sees
+// every insert or remove the same caller queued before it.
+class ShardedHashMap {
+private:
+    struct Shard;
+    vector<unique_ptr<Shard>> shards;
+
+    size_t shardOf(string_view key) const;
+    void submit(size_t shard, function<void(HashMap&)> task);
+
+public:
+    ShardedHashMap(int shardCount, int bucketsPerShard);
+    ~ShardedHashMap();
+    ShardedHashMap(const ShardedHashMap&) = delete;
+    ShardedHashMap& operator=(const ShardedHashMap&) = delete;
+
+    int shardCount() const;
+    // Queued and applied asynchronously; use flush() to wait for them.
+    void insert(const string &key, const Record &record);
+    void remove(string_view key);
+    // Fans the entries out to their shards and waits until all are applied.
+    void insertBatch(span<const pair<string, Record>> entries);
+    optional<Record> search(string_view key);
+    // Fans the keys out to their shards, one request per shard, and gathers
+    // the results: out[i] holds a copy of the match for keys[i], if any.
+    void searchBatch(span<const string_view> keys, span<optional<Record>> out);
+    // Blocks until every request queued so far has run.
+    void flush();
+};
+
+#endif
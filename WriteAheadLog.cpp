@@ -0,0 +1,248 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#include "WriteAheadLog.h"
+#include "RecordIO.h"
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace {
+
+// Entry frame: body length, CRC-32 of the body, body. The body is the
+// sequence number, a remove flag and the encoded record.
+const size_t kFrameHeader = 8;
+const size_t kBodyHeader = 9;
+
+#ifdef _WIN32
+int openFile(const string &path, int flags) { return _open(path.c_str(), flags | _O_BINARY, 0644); }
+const int kReadWrite = _O_RDWR;
+const int kCreateAppend = _O_RDWR | _O_CREAT | _O_APPEND;
+long long readSome(int fd, char *buf, size_t n) { return _read(fd, buf, (unsigned)n); }
+long long writeSome(int fd, const char *buf, size_t n) { return _write(fd, buf, (unsigned)n); }
+bool syncFd(int fd) { return _commit(fd) == 0; }
+bool truncateFd(int fd, uint64_t size) { return _chsize_s(fd, (long long)size) == 0; }
+void closeFile(int fd) { _close(fd); }
+#else
+int openFile(const string &path, int flags) { return ::open(path.c_str(), flags, 0644); }
+const int kReadWrite = O_RDWR;
+const int kCreateAppend = O_RDWR | O_CREAT | O_APPEND;
+long long readSome(int fd, char *buf, size_t n) { return ::read(fd, buf, n); }
+long long writeSome(int fd, const char *buf, size_t n) { return ::write(fd, buf, n); }
+bool syncFd(int fd) { return ::fsync(fd) == 0; }
+bool truncateFd(int fd, uint64_t size) { return ::ftruncate(fd, (off_t)size) == 0; }
+void closeFile(int fd) { ::close(fd); }
+#endif
+
+bool writeAll(int fd, const string &bytes) {
+    size_t done = 0;
+    while (done < bytes.size()) {
+        long long n = writeSome(fd, bytes.data() + done, bytes.size() - done);
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// CRC-32 (IEEE 802.3, reflected), table driven.
+uint32_t crc32(const char *data, size_t size) {
+    static const array<uint32_t, 256> table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void appendFrame(string &out, const LogEntry &entry) {
+    uint32_t bodySize = (uint32_t)(kBodyHeader + encodedRecordSize(entry.record));
+    size_t start = out.size();
+    out.resize(start + kFrameHeader + bodySize);
+    char *body = out.data() + start + kFrameHeader;
+    memcpy(body, &entry.seq, sizeof(entry.seq));
+    body[8] = entry.remove ? 1 : 0;
+    encodeRecord(body + kBodyHeader, entry.record);
+    uint32_t crc = crc32(body, bodySize);
+    memcpy(out.data() + start, &bodySize, sizeof(bodySize));
+    memcpy(out.data() + start + 4, &crc, sizeof(crc));
+}
+
+// Parses the frame at data[pos]; false if it is torn or fails its checksum.
+bool readFrame(const string &data, size_t &pos, LogEntry &entry) {
+    uint32_t bodySize, crc;
+    if (data.size() - pos < kFrameHeader) return false;
+    memcpy(&bodySize, data.data() + pos, sizeof(bodySize));
+    memcpy(&crc, data.data() + pos + 4, sizeof(crc));
+    if (bodySize < kBodyHeader || data.size() - pos - kFrameHeader < bodySize) return false;
+    const char *body = data.data() + pos + kFrameHeader;
+    if (crc32(body, bodySize) != crc) return false;
+    memcpy(&entry.seq, body, sizeof(entry.seq));
+    entry.remove = body[8] != 0;
+    if (!decodeRecord(body + kBodyHeader, bodySize - kBodyHeader, entry.record)) return false;
+    pos += kFrameHeader + bodySize;
+    return true;
+}
+
+}
+
+WriteAheadLog::WriteAheadLog() = default;
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    queued.notify_all();
+    if (flusher.joinable()) flusher.join();
+    if (fd >= 0) closeFile(fd);
+}
+
+bool WriteAheadLog::open(const string &path, uint64_t afterSeq, const WalOptions &walOptions,
+                         const function<void(const LogEntry&)> &apply, size_t &replayed) {
+    replayed = 0;
+    options = walOptions;
+    fd = openFile(path, kCreateAppend);
+    if (fd < 0) {
+        cerr << "Error: could not open log " << path << endl;
+        return false;
+    }
+
+    string data;
+    char buf[1 << 16];
+    for (long long n; (n = readSome(fd, buf, sizeof(buf))) > 0;)
+        data.append(buf, (size_t)n);
+
+    size_t pos = 0;
+    uint64_t lastSeq = afterSeq;
+    LogEntry entry;
+    while (pos < data.size() && readFrame(data, pos, entry)) {
+        if (entry.seq > afterSeq) {
+            apply(entry);
+            ++replayed;
+        }
+        lastSeq = max(lastSeq, entry.seq);
+    }
+    if (pos < data.size()) {
+        cerr << "Discarding " << data.size() - pos << " bytes of damaged log tail in " << path << endl;
+        if (!truncateFd(fd, pos) || !syncFd(fd)) {
+            cerr << "Error: could not truncate log " << path << endl;
+            return false;
+        }
+    }
+
+    nextSeq = lastSeq + 1;
+    durableSeq = lastSeq;
+    flusher = thread([this] { run(); });
+    return true;
+}
+
+// Waits for a batch to gather, then writes and syncs it outside the lock so
+// appenders keep queueing the next batch meanwhile.
+void WriteAheadLog::run() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        queued.wait(guard, [this] { return stopping || pendingEntries > 0; });
+        if (pendingEntries == 0) return;
+        if (!stopping && pendingEntries < options.maxBatch && options.maxDelay.count() > 0) {
+            queued.wait_for(guard, options.maxDelay,
+                            [this] { return stopping || pendingEntries >= options.maxBatch; });
+        }
+        string batch;
+        batch.swap(pending);
+        size_t entries = pendingEntries;
+        uint64_t upTo = nextSeq - 1;
+        pendingEntries = 0;
+
+        guard.unlock();
+        bool ok = writeAll(fd, batch) && (!options.fsync || syncFd(fd));
+        guard.lock();
+
+        if (ok) {
+            durableSeq = upTo;
+            counters.entries += entries;
+            counters.bytes += batch.size();
+            counters.syncs += options.fsync;
+        } else {
+            cerr << "Error: write-ahead log write failed" << endl;
+            failed = true;
+        }
+        synced.notify_all();
+    }
+}
+
+uint64_t WriteAheadLog::append(const LogEntry &entry) {
+    lock_guard<mutex> guard(lock);
+    LogEntry numbered = entry;
+    numbered.seq = nextSeq++;
+    appendFrame(pending, numbered);
+    ++pendingEntries;
+    queued.notify_one();
+    return numbered.seq;
+}
+
+uint64_t WriteAheadLog::appendInsert(const Record &record) {
+    LogEntry entry;
+    entry.record = record;
+    return append(entry);
+}
+
+uint64_t WriteAheadLog::appendRemove(const string &state, int year) {
+    LogEntry entry;
+    entry.remove = true;
+    entry.record.state = state;
+    entry.record.year = year;
+    return append(entry);
+}
+
+bool WriteAheadLog::waitDurable(uint64_t seq) {
+    unique_lock<mutex> guard(lock);
+    synced.wait(guard, [&] { return durableSeq >= seq || failed; });
+    return durableSeq >= seq;
+}
+
+bool WriteAheadLog::truncate() {
+    unique_lock<mutex> guard(lock);
+    synced.wait(guard, [this] { return durableSeq + 1 == nextSeq || failed; });
+    if (failed) return false;
+    // Nothing is queued or being written, and the flusher needs the lock to
+    // start again, so the file is ours until we return.
+    if (!truncateFd(fd, 0) || !syncFd(fd)) {
+        cerr << "Error: could not truncate write-ahead log" << endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t WriteAheadLog::lastSequence() const {
+    lock_guard<mutex> guard(lock);
+    return nextSeq - 1;
+}
+
+WriteAheadLog::Stats WriteAheadLog::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+bool WriteAheadLog::syncFile(const string &path) {
+    int file = openFile(path, kReadWrite);
+    if (file < 0) return false;
+    bool ok = syncFd(file);
+    closeFile(file);
+    return ok;
+}
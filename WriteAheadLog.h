@@ -0,0 +1,87 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include "Record.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Group commit tuning (--wal-batch, --wal-delay on the command line).
+struct WalOptions {
+    size_t maxBatch = 256;                 // sync as soon as this many entries are queued
+    chrono::microseconds maxDelay{200};    // otherwise wait this long for more to join
+    bool fsync = true;                     // false trades durability for speed
+};
+
+// One logged mutation. A removal carries only the state and year.
+struct LogEntry {
+    uint64_t seq = 0;
+    bool remove = false;
+    Record record;
+};
+
+// Append-only log of record mutations. Each entry is framed by its length
+// and a CRC-32 of its body, so a torn or corrupt tail is detected on replay
+// and cut off. Appends only queue an entry; a background thread writes
+// everything queued in one write and one fsync (group commit), which lets
+// concurrent writers share the cost of a sync. Sequence numbers keep rising
+// across checkpoints, so entries already covered by a snapshot are skipped.
+class WriteAheadLog {
+public:
+    struct Stats {
+        uint64_t entries = 0;
+        uint64_t syncs = 0;
+        uint64_t bytes = 0;
+    };
+
+    WriteAheadLog();
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Replays every intact entry newer than afterSeq through apply, cuts off
+    // a damaged tail and opens the log for appending.
+    bool open(const string &path, uint64_t afterSeq, const WalOptions &options,
+              const function<void(const LogEntry&)> &apply, size_t &replayed);
+    // Queue an entry and return its sequence number.
+    uint64_t appendInsert(const Record &record);
+    uint64_t appendRemove(const string &state, int year);
+    // Blocks until entry seq is on disk; false if a write or sync failed.
+    bool waitDurable(uint64_t seq);
+    // Empties the log once a checkpoint covers everything in it.
+    bool truncate();
+    uint64_t lastSequence() const;
+    Stats stats() const;
+
+    // fsyncs a file written through a stream, e.g. a checkpoint snapshot.
+    static bool syncFile(const string &path);
+
+private:
+    int fd = -1;
+    WalOptions options;
+    mutable mutex lock;
+    condition_variable queued;
+    condition_variable synced;
+    string pending;
+    size_t pendingEntries = 0;
+    uint64_t nextSeq = 1;
+    uint64_t durableSeq = 0;
+    bool failed = false;
+    bool stopping = false;
+    Stats counters;
+    thread flusher;
+
+    uint64_t append(const LogEntry &entry);
+    void run();
+};
+
+#endif
@@ -0,0 +1,54 @@
+//
+// Created by anany on 11/3/2025.
+//
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include "HashMap.h"
+#include "BTree.h"
+
+void benchmarkMenu(HashMap &hashTable, BTree &bTree);
+void benchmarkBatchLookup(HashMap &hashTable, BTree &bTree);
+void benchmarkPerfectHash(HashMap &hashTable);
+void benchmarkShardScaling(HashMap &hashTable);
+// Loads a ConcurrentBTree and measures read-only and mixed read/write
+// throughput as the number of threads grows.
+void benchmarkConcurrentBTree(const BTree &bTree);
+// Compares PersistentBTree writes and snapshot cost with BTree and checks
+// that reports over a snapshot stay consistent under a concurrent writer.
+void benchmarkPersistentSnapshots(const BTree &bTree);
+// Builds a disk-backed PagedBTree at least ten times the size of its buffer
+// pool and reports latency, pool hit rate and page I/O per page size.
+void benchmarkPagedBTree(const BTree &bTree);
+// Commits logged changes with an fsync per change, with group commit and
+// without fsync, from one and several threads, and checks they all replay.
+void benchmarkWriteAheadLog(HashMap &hashTable);
+// Reports tree height, node count, key memory per key and separator length
+// for the prefix-truncated node layout, with lookup latency, on the loaded
+// tree and on 1M synthetic keys at several orders.
+void benchmarkBTreeLayout(const BTree &bTree);
+// Range and top-k queries on a jobCreation SecondaryIndex against a full
+// scan, plus the cost of keeping the index up to date.
+void benchmarkSecondaryIndex(HashMap &hashTable, const BTree &bTree);
+// Median, percentile rank and random quantiles from a SecondaryIndex's
+// subtree counts against materializing the values for each question.
+void benchmarkOrderStatistics(HashMap &hashTable, const BTree &bTree);
+// Count/sum/min/max queries over key ranges from BTree subtree aggregates
+// against summing the records of the range, on the loaded tree and a larger
+// synthetic one, plus what maintaining the aggregates adds to an insert.
+void benchmarkRangeAggregates(const BTree &bTree);
+// BTree against BasicBTree instantiations with compile-time order over the
+// same string keys and over packed integer keys: insert, search, per-state
+// scan and remove latency on the loaded data and on 500k distinct keys.
+void benchmarkTemplatedBTree(const BTree &bTree);
+// Removes half of the loaded keys and of 500k synthetic ones with eager and
+// with lazy deletes at orders 2 and 16: delete, compaction and lookup cost,
+// and a check that no removed record is still found and no node is left
+// underfull.
+void benchmarkLazyDelete(const BTree &bTree);
+// Builds trees at a range of orders over a sample of bTree's entries, prints
+// insert/search/scan latency for each and returns the fastest order overall.
+int tuneBTreeOrder(const BTree &bTree);
+
+#endif
@@ -1,21 +1,113 @@
 #include <iostream>
+#include <charconv>
+#include <cstring>
 #include "HashMap.h"
 #include "BTree.h"
 #include "Record.h"
 #include "utils.h"
+#include "benchmarks.h"
 using namespace std;
 
-int main() {
+static const size_t kMinOrder = 2;
+static const size_t kMaxOrder = 1024;
+
+static void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --limit N      print at most N rows per table report\n"
+         << "  --offset N     skip the first N rows of each table report\n"
+         << "  --output FILE  write table reports to FILE instead of the terminal\n"
+         << "  --order N|auto BTree minimum degree (" << kMinOrder << "-" << kMaxOrder << ", default 3);\n"
+         << "                 auto times a range of orders on the loaded data and keeps the fastest\n"
+         << "  --wal FILE     log inserts and deletes to FILE and restore them on the next start\n"
+         << "                 (the checkpoint snapshot is kept in FILE.snapshot)\n"
+         << "  --wal-batch N  sync the log as soon as N changes are queued (default 256)\n"
+         << "  --wal-delay US wait up to US microseconds for a batch to fill (default 200)\n"
+         << "  --checkpoint N checkpoint and empty the log every N changes (default 1000, 0 = at exit only)\n"
+         << "  --index FIELD  keep a secondary index on a numeric record field, e.g. jobCreation\n"
+         << "                 (may be repeated)\n"
+         << "  --aggregate FIELD\n"
+         << "                 keep subtree sums, minima and maxima of a numeric field in the BTree\n"
+         << "                 for Range Aggregates, besides the ones Dataset Statistics uses\n"
+         << "                 (may be repeated)\n"
+         << "  --lazy-delete  BTree deletes only tombstone records; the tree is compacted in one sweep\n"
+         << "                 once tombstones outnumber live records\n";
+}
+
+static bool parseCount(const char* text, size_t& value) {
+    const char* end = text + strlen(text);
+    auto result = from_chars(text, end, value);
+    return result.ec == errc() && result.ptr == end;
+}
+
+int main(int argc, char* argv[]) {
+    ReportOptions reportOptions;
+    DurabilityOptions durability;
+    size_t walBatch = durability.wal.maxBatch;
+    size_t walDelay = (size_t)durability.wal.maxDelay.count();
+    size_t order = 3;
+    bool autoOrder = false;
+    bool lazyDelete = false;
+    vector<string> indexFields;
+    vector<string> aggregateFields;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--limit" && hasValue && parseCount(argv[i + 1], reportOptions.limit)) {
+            ++i;
+        } else if (arg == "--offset" && hasValue && parseCount(argv[i + 1], reportOptions.offset)) {
+            ++i;
+        } else if (arg == "--output" && hasValue) {
+            reportOptions.outputPath = argv[++i];
+        } else if (arg == "--wal" && hasValue) {
+            durability.logPath = argv[++i];
+        } else if (arg == "--wal-batch" && hasValue && parseCount(argv[i + 1], walBatch) && walBatch > 0) {
+            ++i;
+        } else if (arg == "--wal-delay" && hasValue && parseCount(argv[i + 1], walDelay)) {
+            ++i;
+        } else if (arg == "--checkpoint" && hasValue && parseCount(argv[i + 1], durability.checkpointEvery)) {
+            ++i;
+        } else if (arg == "--index" && hasValue && findNumericField(argv[i + 1])) {
+            indexFields.push_back(argv[++i]);
+        } else if (arg == "--aggregate" && hasValue && findNumericField(argv[i + 1])) {
+            aggregateFields.push_back(argv[++i]);
+        } else if (arg == "--lazy-delete") {
+            lazyDelete = true;
+        } else if (arg == "--order" && hasValue && strcmp(argv[i + 1], "auto") == 0) {
+            autoOrder = true;
+            ++i;
+        } else if (arg == "--order" && hasValue && parseCount(argv[i + 1], order)
+                   && order >= kMinOrder && order <= kMaxOrder) {
+            ++i;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    setReportOptions(reportOptions);
+    durability.wal.maxBatch = walBatch;
+    durability.wal.maxDelay = chrono::microseconds(walDelay);
+
     cout << "Program started!" << endl;
 
     HashMap hashTable(10000);
-    BTree bTree(3);
+    BTree bTree((int)order);
 
     string filename = "bds_data.csv";
-    loadDataFromCSV(filename, hashTable, bTree);
+    if (!openDataStore(filename, durability, hashTable, bTree))
+        return 1;
+    if (autoOrder)
+        bTree.setOrder(tuneBTreeOrder(bTree));
+    trackAggregateFields(aggregateFields, bTree);
+    bTree.setLazyDelete(lazyDelete);
+    for (const string& field : indexFields)
+        createSecondaryIndex(field, bTree);
+    // Sessions are mostly lookups and reports; the first insert or delete
+    // drops the snapshot again.
+    bTree.freeze();
 
     cout << "Data loaded successfully." << endl;
     mainMenu(hashTable, bTree);
+    closeDataStore(bTree);
 
     return 0;
 }
@@ -3,6 +3,9 @@
 //
 
 #include "utils.h"
+#include "benchmarks.h"
+#include "Key.h"
+#include "RecordIO.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -12,14 +15,24 @@
 #include <filesystem>
 #include <chrono>
 #include <algorithm>
-#include <map>
-#include <set>
-#include <climits>
+#include <memory>
 #include <unordered_map>
 
 using namespace std::chrono;
 using namespace std;
 
+static ReportOptions reportOptions;
+static DurabilityOptions durability;
+static unique_ptr<WriteAheadLog> journal;
+static size_t changesSinceCheckpoint = 0;
+static vector<unique_ptr<SecondaryIndex>> secondaryIndexes;
+
+static const char kSnapshotMagic[8] = {'B', 'D', 'X', 'S', 'N', 'A', 'P', '1'};
+
+void setReportOptions(const ReportOptions &options) {
+    reportOptions = options;
+}
+
 vector<string> stateList = {
     "Alabama","Alaska","Arizona","Arkansas","California","Colorado","Connecticut","Delaware","Florida","Georgia",
     "Hawaii","Idaho","Illinois","Indiana","Iowa","Kansas","Kentucky","Louisiana","Maine","Maryland",
@@ -83,7 +96,7 @@ void loadDataFromCSV(const string &filename, HashMap &hashTable, BTree &bTree) {
     while (getline(file, line)) {
         if (line.empty()) continue;
         Record r = parseRecord(line);
-        string key = r.state + "_" + to_string(r.year);
+        string key = makeKey(r.state, r.year);
         hashTable.insert(key, r);
         bTree.insert(key, r);
         count++;
@@ -133,10 +146,157 @@ void generateRandomData(HashMap &hashTable, BTree &bTree, int count) {
         r.jobDestruction = jobDist(gen);
         r.jobDestructionRate = rateDist(gen);
 
-        string key = r.state + "_" + to_string(r.year);
+        string key = makeKey(r.state, r.year);
+        hashTable.insert(key, r);
+        bTree.insert(key, r);
+    }
+}
+
+static string snapshotPath() {
+    return durability.logPath + ".snapshot";
+}
+
+// Snapshot layout: magic, sequence number of the last logged change it
+// covers, record count, records in BTree order (oldest first per key).
+static bool loadSnapshot(const string &path, HashMap &hashTable, BTree &bTree, uint64_t &seq) {
+    ifstream in(path, ios::binary);
+    char magic[sizeof(kSnapshotMagic)];
+    uint64_t count;
+    if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), kSnapshotMagic)
+        || !readPod(in, seq) || !readPod(in, count)) {
+        cerr << "Error: " << path << " is not a checkpoint snapshot" << endl;
+        return false;
+    }
+    Record r;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!readRecord(in, r)) {
+            cerr << "Error: truncated checkpoint snapshot " << path << endl;
+            return false;
+        }
+        string key = makeKey(r.state, r.year);
         hashTable.insert(key, r);
         bTree.insert(key, r);
     }
+    cout << "Loaded " << count << " records from checkpoint " << path << "." << endl;
+    return true;
+}
+
+bool checkpoint(BTree &bTree) {
+    if (!journal) return true;
+    // Written aside and renamed over the old snapshot, so a crash leaves
+    // either the old snapshot with the full log or the new one.
+    string path = snapshotPath();
+    string temp = path + ".tmp";
+    uint64_t seq = journal->lastSequence();
+    {
+        ofstream out(temp, ios::binary | ios::trunc);
+        uint64_t count = 0;
+        bTree.forEach([&](const string &, const Record &) { ++count; });
+        out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+        writePod(out, seq);
+        writePod(out, count);
+        bTree.forEach([&](const string &, const Record &r) { writeRecord(out, r); });
+        if (!out) {
+            cerr << "Error: could not write checkpoint " << temp << endl;
+            return false;
+        }
+    }
+    error_code ec;
+    if (WriteAheadLog::syncFile(temp))
+        filesystem::rename(temp, path, ec);
+    else
+        ec = make_error_code(errc::io_error);
+    if (ec) {
+        cerr << "Error: could not install checkpoint " << path << endl;
+        return false;
+    }
+    changesSinceCheckpoint = 0;
+    return journal->truncate();
+}
+
+bool openDataStore(const string &csvPath, const DurabilityOptions &options, HashMap &hashTable, BTree &bTree) {
+    durability = options;
+    if (durability.logPath.empty()) {
+        loadDataFromCSV(csvPath, hashTable, bTree);
+        return true;
+    }
+
+    uint64_t seq = 0;
+    bool restored = filesystem::exists(snapshotPath());
+    if (restored) {
+        if (!loadSnapshot(snapshotPath(), hashTable, bTree, seq)) return false;
+    } else {
+        loadDataFromCSV(csvPath, hashTable, bTree);
+    }
+
+    journal = make_unique<WriteAheadLog>();
+    size_t replayed = 0;
+    bool opened = journal->open(durability.logPath, seq, durability.wal, [&](const LogEntry &entry) {
+        const Record &r = entry.record;
+        if (entry.remove) {
+            hashTable.remove(r.state, r.year);
+            bTree.remove(r.state, r.year);
+        } else {
+            string key = makeKey(r.state, r.year);
+            hashTable.insert(key, r);
+            bTree.insert(key, r);
+        }
+    }, replayed);
+    if (!opened) {
+        journal.reset();
+        return false;
+    }
+    changesSinceCheckpoint = replayed;
+    if (replayed > 0)
+        cout << "Replayed " << replayed << " logged changes from " << durability.logPath << "." << endl;
+    // Fixes the random padding of a first CSV load as the base later runs
+    // replay onto.
+    return restored || checkpoint(bTree);
+}
+
+void closeDataStore(BTree &bTree) {
+    if (journal && changesSinceCheckpoint > 0)
+        checkpoint(bTree);
+    journal.reset();
+}
+
+// Counts a logged change and checkpoints every checkpointEvery of them.
+static void noteChange(BTree &bTree) {
+    if (durability.checkpointEvery > 0 && ++changesSinceCheckpoint >= durability.checkpointEvery)
+        checkpoint(bTree);
+}
+
+bool insertRecord(HashMap &hashTable, BTree &bTree, const Record &r) {
+    if (journal && !journal->waitDurable(journal->appendInsert(r))) {
+        cerr << "Error: the change could not be logged and was not applied." << endl;
+        return false;
+    }
+    string key = makeKey(r.state, r.year);
+    hashTable.insert(key, r);
+    bTree.insert(key, r);
+    for (auto &index : secondaryIndexes)
+        index->insert(r);
+    if (journal) noteChange(bTree);
+    return true;
+}
+
+void deleteRecord(HashMap &hashTable, BTree &bTree, const string &state, int year) {
+    // Deletes of absent records are not logged; replaying them would only
+    // print "not present" again.
+    bool logged = journal && hashTable.search(state, year);
+    if (logged && !journal->waitDurable(journal->appendRemove(state, year))) {
+        cerr << "Error: the change could not be logged and was not applied." << endl;
+        return;
+    }
+    // Both structures drop the oldest record under the key, so that is the
+    // one whose index entries go.
+    if (const Record *old = hashTable.search(state, year)) {
+        for (auto &index : secondaryIndexes)
+            index->remove(*old);
+    }
+    hashTable.remove(state, year);
+    bTree.remove(state, year);
+    if (logged) noteChange(bTree);
 }
 
 // Main interactive menu
@@ -157,7 +317,11 @@ void mainMenu(HashMap &hashTable, BTree &bTree) {
         cout << "[5] Top/Bottom 5 by Job Creation\n";
         cout << "[6] Dataset Statistics\n";
         cout << "[7] Compare Data Structures\n";
-        cout << "[8] Exit\n";
+        cout << "[8] Benchmarks\n";
+        cout << "[9] Show All Records\n";
+        cout << "[10] Secondary Indexes\n";
+        cout << "[11] Range Aggregates\n";
+        cout << "[12] Exit\n";
         cout << "========================================================================================================================\n";
         cout << "Enter choice: ";
         cin >> choice;
@@ -172,10 +336,8 @@ void mainMenu(HashMap &hashTable, BTree &bTree) {
             cout << "Enter Net Job Creation: "; cin >> r.netJobCreation;
             cout << "Enter Net Job Creation Rate: "; cin >> r.netJobCreationRate;
 
-            string key = r.state + "_" + to_string(r.year);
-            hashTable.insert(key, r);
-            bTree.insert(key, r);
-            cout << "Record inserted successfully." << endl;
+            if (insertRecord(hashTable, bTree, r))
+                cout << "Record inserted successfully." << endl;
         }
         else if (choice == 2) {
             cout << "\n--- Search Record by State and Year ---\n";
@@ -185,17 +347,15 @@ void mainMenu(HashMap &hashTable, BTree &bTree) {
             cout << "Enter Year: ";
             cin >> year;
             
-            string key = state + "_" + to_string(year);
-            
             // Search in Hash Table
             auto start = high_resolution_clock::now();
-            Record *recHash = hashTable.search(key);
+            Record *recHash = hashTable.search(state, year);
             auto end = high_resolution_clock::now();
             double hashTime = duration_cast<microseconds>(end - start).count() / 1000.0;
             
             // Search in BTree
             start = high_resolution_clock::now();
-            Record *recBTree = bTree.search(key);
+            Record *recBTree = bTree.search(state, year);
             end = high_resolution_clock::now();
             double btreeTime = duration_cast<microseconds>(end - start).count() / 1000.0;
             
@@ -216,9 +376,7 @@ void mainMenu(HashMap &hashTable, BTree &bTree) {
             cout << "\n--- Delete Record ---\n";
             cout << "Enter State: "; cin >> ws; getline(cin, state);
             cout << "Enter Year: "; cin >> year;
-            string key = state + "_" + to_string(year);
-            hashTable.remove(key);
-            bTree.remove(key);
+            deleteRecord(hashTable, bTree, state, year);
             cout << "Record deleted successfully from both structures.\n";
         }
         else if (choice == 4) {
@@ -228,12 +386,24 @@ void mainMenu(HashMap &hashTable, BTree &bTree) {
             showTopBottomJobCreation(hashTable, bTree);
         }
         else if (choice == 6) {
-            showDatasetStatistics(hashTable, bTree);
+            showDatasetStatistics(bTree);
         }
         else if (choice == 7) {
             comparePerformance(hashTable, bTree);
         }
         else if (choice == 8) {
+            benchmarkMenu(hashTable, bTree);
+        }
+        else if (choice == 9) {
+            showAllRecords(hashTable);
+        }
+        else if (choice == 10) {
+            secondaryIndexMenu(bTree);
+        }
+        else if (choice == 11) {
+            showRangeAggregates(bTree);
+        }
+        else if (choice == 12) {
             cout << "Exiting program..." << endl;
             break;
         }
@@ -268,6 +438,8 @@ void comparePerformance(HashMap &hashTable, BTree &bTree) {
     auto end = chrono::high_resolution_clock::now();
     double hashSearch = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
+    bool wasFrozen = bTree.isFrozen();
+    bTree.thaw();
     start = chrono::high_resolution_clock::now();
     for (int i = 0; i < testCount; ++i) {
         bTree.search(keys[i]);
@@ -275,6 +447,24 @@ void comparePerformance(HashMap &hashTable, BTree &bTree) {
     end = chrono::high_resolution_clock::now();
     double btreeSearch = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
+    // Same lookups against the read-only snapshot.
+    bTree.freeze();
+    start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < testCount; ++i) {
+        bTree.search(keys[i]);
+    }
+    end = chrono::high_resolution_clock::now();
+    double frozenSearch = chrono::duration_cast<chrono::microseconds>(end - start).count();
+
+    // Inserts and deletes run on copies, so the comparison leaves the data,
+    // the secondary indexes and the write-ahead log as they were.
+    HashMap hashCopy(10000);
+    hashTable.forEach([&](const string &key, const Record &r) { hashCopy.insert(key, r); });
+    BTree treeCopy(bTree.t);
+    treeCopy.trackAggregates(bTree.aggregateFields());
+    treeCopy.setLazyDelete(bTree.lazyDelete());
+    bTree.forEach([&](const string &key, const Record &r) { treeCopy.insert(key, r); });
+
     // ===== INSERT TEST =====
     vector<Record> inserts;
     uniform_int_distribution<> yearDist(1978, 2020);
@@ -304,18 +494,22 @@ void comparePerformance(HashMap &hashTable, BTree &bTree) {
         inserts.push_back(r);
     }
 
+    // Build the keys up front so the timed loops measure only the inserts
+    vector<string> insertKeys;
+    for (const Record& r : inserts) {
+        insertKeys.push_back(makeKey(r.state, r.year));
+    }
+
     start = chrono::high_resolution_clock::now();
     for (int i = 0; i < testCount; ++i) {
-        string key = inserts[i].state + "_" + to_string(inserts[i].year);
-        hashTable.insert(key, inserts[i]);
+        hashCopy.insert(insertKeys[i], inserts[i]);
     }
     end = chrono::high_resolution_clock::now();
     double hashInsert = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
     start = chrono::high_resolution_clock::now();
     for (int i = 0; i < testCount; ++i) {
-        string key = inserts[i].state + "_" + to_string(inserts[i].year);
-        bTree.insert(key, inserts[i]);
+        treeCopy.insert(insertKeys[i], inserts[i]);
     }
     end = chrono::high_resolution_clock::now();
     double btreeInsert = chrono::duration_cast<chrono::microseconds>(end - start).count();
@@ -323,14 +517,14 @@ void comparePerformance(HashMap &hashTable, BTree &bTree) {
     // ===== DELETE TEST =====
     start = chrono::high_resolution_clock::now();
     for (int i = 0; i < testCount; ++i) {
-        hashTable.remove(keys[i]);
+        hashCopy.remove(keys[i]);
     }
     end = chrono::high_resolution_clock::now();
     double hashDelete = chrono::duration_cast<chrono::microseconds>(end - start).count();
 
     start = chrono::high_resolution_clock::now();
     for (int i = 0; i < testCount; ++i) {
-        bTree.remove(keys[i]);
+        treeCopy.remove(keys[i]);
     }
     end = chrono::high_resolution_clock::now();
     double btreeDelete = chrono::duration_cast<chrono::microseconds>(end - start).count();
@@ -340,270 +534,497 @@ void comparePerformance(HashMap &hashTable, BTree &bTree) {
     cout << "Average Time per Operation (microseconds per op):\n";
     cout << left << setw(20) << "Operation"
          << setw(20) << "HashMap"
-         << setw(20) << "BTree" << endl;
-    cout << string(60, '-') << endl;
+         << setw(20) << "BTree"
+         << setw(20) << "BTree (frozen)" << endl;
+    cout << string(80, '-') << endl;
     cout << left << setw(20) << "Search"
          << setw(20) << (hashSearch / testCount)
-         << setw(20) << (btreeSearch / testCount) << endl;
+         << setw(20) << (btreeSearch / testCount)
+         << setw(20) << (frozenSearch / testCount) << endl;
     cout << left << setw(20) << "Insert"
          << setw(20) << (hashInsert / testCount)
-         << setw(20) << (btreeInsert / testCount) << endl;
+         << setw(20) << (btreeInsert / testCount)
+         << setw(20) << "-" << endl;
     cout << left << setw(20) << "Delete"
          << setw(20) << (hashDelete / testCount)
-         << setw(20) << (btreeDelete / testCount) << endl;
+         << setw(20) << (btreeDelete / testCount)
+         << setw(20) << "-" << endl;
+
+    if (!wasFrozen)
+        bTree.thaw();
+}
+
+// Footer for paged table reports, printed after the table itself.
+static void printPageSummary(const ReportWriter& writer, size_t total) {
+    if (writer.toFile()) {
+        cout << "Wrote " << writer.rowsPrinted() << " rows to " << writer.path() << "\n";
+    } else if (writer.rowsPrinted() < total) {
+        cout << "Showing " << writer.rowsPrinted() << " of " << total << " rows (--limit/--offset)\n";
+    }
+}
+
+// One block of the top/bottom report: the first five records as ranked.
+static void writeJobCreationTable(ReportWriter& writer, const string& title, const vector<const Record*>& ranked) {
+    writer.text("\n========================================================================================================================\n");
+    writer.text("                                    ");
+    writer.text(title);
+    writer.text("\n========================================================================================================================\n");
+    writer.cell("State", 15);
+    writer.cell("Year", 8);
+    writer.cell("Job Creation", 15);
+    writer.cell("Job Creation Rate", 20);
+    writer.cell("Net Job Creation", 20);
+    writer.cell("Number of Firms", 20);
+    writer.text("\n");
+    writer.text(string(93, '-'));
+    writer.text("\n");
+    
+    int count = min(5, (int)ranked.size());
+    for (int i = 0; i < count; i++) {
+        const Record &r = *ranked[i];
+        writer.beginRow();
+        writer.cell(r.state, 15);
+        writer.number(r.year, 8);
+        writer.number(r.jobCreation, 15);
+        writer.decimal(r.jobCreationRate, 20, 2);
+        writer.number(r.netJobCreation, 20);
+        writer.number(r.numberOfFirms, 20);
+        writer.endRow();
+    }
+}
+
+void showAllRecords(HashMap &hashTable) {
+    ReportWriter writer(reportOptions);
+    auto start = high_resolution_clock::now();
+    hashTable.display(writer);
+    auto end = high_resolution_clock::now();
+    printPageSummary(writer, hashTable.size());
+    cout << "Report Time: " << fixed << setprecision(3)
+         << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
 }
 
+// Rows are streamed from a BTree cursor over the "State_" keys, forwards or
+// backwards for latest years first, so the report copies no records.
 void showAllRecordsForState(HashMap &hashTable, BTree &bTree) {
     string state;
+    char latestFirst;
     cout << "\n--- Show All Records for State ---\n";
     cout << "Enter State: ";
     cin >> ws;
     getline(cin, state);
+    cout << "Latest years first? (y/n): ";
+    cin >> latestFirst;
+    bool reverse = latestFirst == 'y' || latestFirst == 'Y';
     
     string prefix = state + "_";
+    // '`' follows '_', so every key of the state sorts before this one.
+    string end = state + "`";
     
     // Search in Hash Table
     auto start = high_resolution_clock::now();
     vector<pair<string, Record>> hashResults = hashTable.searchPrefix(prefix);
-    auto end = high_resolution_clock::now();
-    double hashTime = duration_cast<microseconds>(end - start).count() / 1000.0;
+    auto stop = high_resolution_clock::now();
+    double hashTime = duration_cast<microseconds>(stop - start).count() / 1000.0;
     
-    // Search in BTree
+    // Search in BTree: position a cursor on the state's first (or last) record
+    BTree::Cursor cursor = bTree.cursor();
     start = high_resolution_clock::now();
-    vector<pair<string, Record>> btreeResults = bTree.searchPrefix(prefix);
-    end = high_resolution_clock::now();
-    double btreeTime = duration_cast<microseconds>(end - start).count() / 1000.0;
+    if (reverse)
+        cursor.seekBefore(end);
+    else
+        cursor.seek(prefix);
+    size_t total = bTree.rank(end) - bTree.rank(prefix);
+    stop = high_resolution_clock::now();
+    double btreeTime = duration_cast<microseconds>(stop - start).count() / 1000.0;
     
-    // Sort results by year
-    sort(hashResults.begin(), hashResults.end(), 
-         [](const pair<string, Record>& a, const pair<string, Record>& b) {
-             return a.second.year < b.second.year;
-         });
-    
-    if (hashResults.empty()) {
+    if (total == 0) {
         cout << "No records found for state: " << state << endl;
         return;
     }
     
-    cout << "\n========================================================================================================================\n";
-    cout << "                                    All Records for " << state << "\n";
-    cout << "========================================================================================================================\n";
-    cout << left
-         << setw(12) << "State"
-         << setw(6)  << "Year"
-         << setw(10) << "Firms"
-         << setw(12) << "NetJob"
-         << setw(10) << "JobRate"
-         << setw(12) << "Realloc"
-         << setw(12) << "Entered"
-         << setw(10) << "EntRate"
-         << setw(10) << "Exited"
-         << setw(10) << "ExRate"
-         << setw(10) << "PhysLoc"
-         << setw(10) << "FirmEx"
-         << setw(12) << "JobCreate"
-         << setw(10) << "CreateR"
-         << setw(12) << "JobDestr"
-         << setw(10) << "DestrR"
-         << endl;
-    cout << string(160, '-') << endl;
+    ReportWriter writer(reportOptions);
+    writer.text("\n========================================================================================================================\n");
+    writer.text("                                    All Records for ");
+    writer.text(state);
+    writer.text(reverse ? " (latest first)" : "");
+    writer.text("\n========================================================================================================================\n");
+    writeRecordTableHeader(writer);
     
-    for (const auto& entry : hashResults) {
-        const Record &r = entry.second;
-        cout << left << setw(12) << r.state
-             << setw(6)  << r.year
-             << setw(10) << r.numberOfFirms
-             << setw(12) << r.netJobCreation
-             << setw(10) << fixed << setprecision(2) << r.netJobCreationRate
-             << setw(12) << fixed << setprecision(2) << r.reallocationRate
-             << setw(12) << r.establishmentsEntered
-             << setw(10) << fixed << setprecision(2) << r.enteredRate
-             << setw(10) << r.establishmentsExited
-             << setw(10) << fixed << setprecision(2) << r.exitedRate
-             << setw(10) << r.physicalLocations
-             << setw(10) << r.firmExits
-             << setw(12) << r.jobCreation
-             << setw(10) << fixed << setprecision(2) << r.jobCreationRate
-             << setw(12) << r.jobDestruction
-             << setw(10) << fixed << setprecision(2) << r.jobDestructionRate
-             << endl;
+    for (size_t row = 0; row < total && !writer.pageFull(); ++row) {
+        if (writer.beginRow())
+            writeRecordRow(writer, cursor.record());
+        if (reverse)
+            cursor.prev();
+        else
+            cursor.next();
     }
     
-    cout << "========================================================================================================================\n";
-    cout << "Total records found: " << hashResults.size() << "\n";
+    writer.text("========================================================================================================================\n");
+    writer.flush();
+    printPageSummary(writer, total);
+    cout << "Total records found: " << total << "\n";
     cout << "Search Time (Hash Table): " << fixed << setprecision(3) << hashTime << " ms\n";
-    cout << "Search Time (BTree): " << fixed << setprecision(3) << btreeTime << " ms\n";
+    cout << "Search Time (BTree cursor seek): " << fixed << setprecision(3) << btreeTime << " ms\n";
 }
 
 void showTopBottomJobCreation(HashMap &hashTable, BTree &bTree) {
     cout << "\n--- Top/Bottom 5 by Job Creation ---\n";
     
-    vector<string> keys = hashTable.getAllKeys();
-    if (keys.empty()) {
-        cout << "No data available.\n";
-        return;
-    }
-    
-    vector<pair<string, Record>> allRecords;
-    for (const string& key : keys) {
-        Record* rec = hashTable.search(key);
-        if (rec) {
-            allRecords.push_back({key, *rec});
+    // Single pass: keep the record with the highest jobCreation for each state
+    unordered_map<string, const Record*> bestPerState;
+    hashTable.forEach([&](const string&, const Record& r) {
+        const Record*& best = bestPerState[r.state];
+        if (!best || r.jobCreation > best->jobCreation) {
+            best = &r;
         }
-    }
+    });
 
-    // Prevent duplicates
-    unordered_map<string, Record> bestPerState;
-    for (const auto& entry : allRecords) {
-        const string& state = entry.second.state;
-        // Keep the record with the highest jobCreation for each state
-        if (!bestPerState.count(state) || entry.second.jobCreation > bestPerState[state].jobCreation) {
-            bestPerState[state] = entry.second;
-        }
+    if (bestPerState.empty()) {
+        cout << "No data available.\n";
+        return;
     }
 
-    // Rebuild allRecords with only one best record per state
-    allRecords.clear();
+    vector<const Record*> allRecords;
     for (const auto& best : bestPerState) {
-        allRecords.push_back({best.first, best.second});
+        allRecords.push_back(best.second);
     }
     
     // Sort by job creation (descending for top, ascending for bottom)
     sort(allRecords.begin(), allRecords.end(),
-         [](const pair<string, Record>& a, const pair<string, Record>& b) {
-             return a.second.jobCreation > b.second.jobCreation;
+         [](const Record* a, const Record* b) {
+             return a->jobCreation > b->jobCreation;
          });
     
-    cout << "\n========================================================================================================================\n";
-    cout << "                                    TOP 5 BY JOB CREATION\n";
-    cout << "========================================================================================================================\n";
-    cout << left
-         << setw(15) << "State"
-         << setw(8)  << "Year"
-         << setw(15) << "Job Creation"
-         << setw(20) << "Job Creation Rate"
-         << setw(20) << "Net Job Creation "
-         << setw(20) << "Number of Firms"
-         << endl;
-    cout << string(93, '-') << endl;
-    
-    int count = min(5, (int)allRecords.size());
-    for (int i = 0; i < count; i++) {
-        const Record &r = allRecords[i].second;
-        cout << left << setw(15) << r.state
-             << setw(8)  << r.year
-             << setw(15) << r.jobCreation
-             << setw(20) << fixed << setprecision(2) << r.jobCreationRate
-             << setw(20) << r.netJobCreation
-             << setw(20) << r.numberOfFirms
-             << endl;
-    }
+    ReportWriter writer(reportOptions, false);
+    writeJobCreationTable(writer, "TOP 5 BY JOB CREATION", allRecords);
     
     // Sort by job creation (ascending for bottom)
     sort(allRecords.begin(), allRecords.end(),
-         [](const pair<string, Record>& a, const pair<string, Record>& b) {
-             return a.second.jobCreation < b.second.jobCreation;
+         [](const Record* a, const Record* b) {
+             return a->jobCreation < b->jobCreation;
          });
     
-    cout << "\n========================================================================================================================\n";
-    cout << "                                    BOTTOM 5 BY JOB CREATION\n";
-    cout << "========================================================================================================================\n";
-    cout << left
-         << setw(15) << "State"
-         << setw(8)  << "Year"
-         << setw(15) << "Job Creation"
-         << setw(20) << "Job Creation Rate"
-         << setw(20) << "Net Job Creation"
-         << setw(20) << "Number of Firms"
-         << endl;
-    cout << string(93, '-') << endl;
-    
-    for (int i = 0; i < count; i++) {
-        const Record &r = allRecords[i].second;
-        cout << left << setw(15) << r.state
-             << setw(8)  << r.year
-             << setw(15) << r.jobCreation
-             << setw(20) << fixed << setprecision(2) << r.jobCreationRate
-             << setw(20) << r.netJobCreation
-             << setw(20) << r.numberOfFirms
-             << endl;
+    writeJobCreationTable(writer, "BOTTOM 5 BY JOB CREATION", allRecords);
+    writer.text("========================================================================================================================\n");
+    writer.flush();
+    if (writer.toFile()) {
+        cout << "Report written to " << writer.path() << "\n";
     }
-    cout << "========================================================================================================================\n";
 }
 
-void showDatasetStatistics(HashMap &hashTable, BTree &bTree) {
+// Fields Dataset Statistics reads from the BTree's root aggregates.
+static const char *const kStatisticsFields[] = {
+    "year", "numberOfFirms", "jobCreation", "jobDestruction", "netJobCreation", "jobCreationRate",
+};
+
+void trackAggregateFields(const vector<string> &extraFields, BTree &bTree) {
+    vector<const NumericField *> fields;
+    auto add = [&](string_view name) {
+        const NumericField *field = findNumericField(name);
+        if (field && find(fields.begin(), fields.end(), field) == fields.end())
+            fields.push_back(field);
+    };
+    for (const char *name : kStatisticsFields) add(name);
+    for (const string &name : extraFields) add(name);
+    bTree.trackAggregates(fields);
+}
+
+// The aggregate of the named field, or an empty one if it is not tracked.
+static Aggregate findAggregate(const BTree &bTree, const vector<Aggregate> &aggregates, string_view name) {
+    const vector<const NumericField *> &fields = bTree.aggregateFields();
+    for (size_t f = 0; f < fields.size() && f < aggregates.size(); ++f) {
+        if (name == fields[f]->name)
+            return aggregates[f];
+    }
+    return Aggregate();
+}
+
+// Totals come from the root's aggregates. States are counted by stepping
+// from the first key of each state to the first key past its "State_" range
+// with rank/select, so the whole report costs O(states * log n).
+void showDatasetStatistics(BTree &bTree) {
     cout << "\n--- Dataset Statistics ---\n";
-    
-    vector<string> keys = hashTable.getAllKeys();
-    if (keys.empty()) {
+
+    auto start = high_resolution_clock::now();
+    size_t totalRecords = bTree.size();
+    if (totalRecords == 0) {
         cout << "No data available.\n";
         return;
     }
-    
-    vector<Record> allRecords;
-    for (const string& key : keys) {
-        Record* rec = hashTable.search(key);
-        if (rec) {
-            allRecords.push_back(*rec);
-        }
-    }
-    
-    if (allRecords.empty()) {
-        cout << "No records found.\n";
-        return;
-    }
-    
-    // Calculate statistics
-    int totalRecords = allRecords.size();
-    int totalFirms = 0;
-    long long totalJobCreation = 0;
-    long long totalJobDestruction = 0;
-    long long totalNetJobCreation = 0;
-    double totalJobCreationRate = 0.0;
-    set<string> uniqueStates;
-    set<int> uniqueYears;
-    int minYear = INT_MAX, maxYear = INT_MIN;
-    
-    for (const Record& r : allRecords) {
-        totalFirms += r.numberOfFirms;
-        totalJobCreation += r.jobCreation;
-        totalJobDestruction += r.jobDestruction;
-        totalNetJobCreation += r.netJobCreation;
-        totalJobCreationRate += r.jobCreationRate;
-        uniqueStates.insert(r.state);
-        uniqueYears.insert(r.year);
-        if (r.year < minYear) minYear = r.year;
-        if (r.year > maxYear) maxYear = r.year;
-    }
-    
-    double avgJobCreationRate = totalJobCreationRate / totalRecords;
-    
-    // Find state with most records
-    map<string, int> stateCounts;
-    for (const Record& r : allRecords) {
-        stateCounts[r.state]++;
-    }
-    string mostRecordsState = "";
-    int maxStateCount = 0;
-    for (const auto& pair : stateCounts) {
-        if (pair.second > maxStateCount) {
-            maxStateCount = pair.second;
-            mostRecordsState = pair.first;
+    vector<Aggregate> totals = bTree.aggregates();
+    Aggregate years = findAggregate(bTree, totals, "year");
+    Aggregate firms = findAggregate(bTree, totals, "numberOfFirms");
+    Aggregate jobCreation = findAggregate(bTree, totals, "jobCreation");
+    Aggregate jobDestruction = findAggregate(bTree, totals, "jobDestruction");
+    Aggregate netJobCreation = findAggregate(bTree, totals, "netJobCreation");
+    Aggregate jobCreationRate = findAggregate(bTree, totals, "jobCreationRate");
+
+    size_t uniqueStates = 0;
+    string mostRecordsState;
+    size_t maxStateCount = 0;
+    string key;
+    for (size_t at = 0; bTree.select(at, &key); ++uniqueStates) {
+        string state = key.substr(0, key.rfind('_'));
+        // '`' follows '_', so this is the first key after every "State_..." key.
+        size_t end = bTree.rank(state + '`');
+        if (end - at > maxStateCount) {
+            maxStateCount = end - at;
+            mostRecordsState = state;
         }
+        at = end;
     }
+    auto end = high_resolution_clock::now();
     
     cout << "\n========================================================================================================================\n";
     cout << "                                    DATASET STATISTICS\n";
     cout << "========================================================================================================================\n";
     cout << left << setw(40) << "Total Records:" << right << setw(20) << totalRecords << "\n";
-    cout << left << setw(40) << "Unique States:" << right << setw(20) << uniqueStates.size() << "\n";
-    cout << left << setw(40) << "Year Range:" << right << setw(20) << (to_string(minYear) + " - " + to_string(maxYear)) << "\n";
-    cout << left << setw(40) << "Total Number of Firms:" << right << setw(20) << totalFirms << "\n";
-    cout << left << setw(40) << "Total Job Creation:" << right << setw(20) << totalJobCreation << "\n";
-    cout << left << setw(40) << "Total Job Destruction:" << right << setw(20) << totalJobDestruction << "\n";
-    cout << left << setw(40) << "Total Net Job Creation:" << right << setw(20) << totalNetJobCreation << "\n";
-    cout << left << setw(40) << fixed << setprecision(2) << "Average Job Creation Rate:" << right << setw(20) << avgJobCreationRate << "%\n";
+    cout << left << setw(40) << "Unique States:" << right << setw(20) << uniqueStates << "\n";
+    cout << left << setw(40) << "Year Range:" << right << setw(20)
+         << (to_string((int)years.min) + " - " + to_string((int)years.max)) << "\n";
+    cout << left << setw(40) << "Total Number of Firms:" << right << setw(20) << (long long)firms.sum << "\n";
+    cout << left << setw(40) << "Total Job Creation:" << right << setw(20) << (long long)jobCreation.sum << "\n";
+    cout << left << setw(40) << "Total Job Destruction:" << right << setw(20) << (long long)jobDestruction.sum << "\n";
+    cout << left << setw(40) << "Total Net Job Creation:" << right << setw(20) << (long long)netJobCreation.sum << "\n";
+    cout << left << setw(40) << fixed << setprecision(2) << "Average Job Creation Rate:" << right << setw(20) << jobCreationRate.mean() << "%\n";
     cout << left << setw(40) << "State with Most Records:" << right << setw(20) << (mostRecordsState + " (" + to_string(maxStateCount) + " records)") << "\n";
     cout << "========================================================================================================================\n";
+    cout << "Query Time: " << fixed << setprecision(3) << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+}
+
+bool createSecondaryIndex(const string &fieldName, BTree &bTree) {
+    const NumericField *field = findNumericField(fieldName);
+    if (!field) {
+        cerr << "Error: " << fieldName << " is not a numeric record field" << endl;
+        return false;
+    }
+    for (const auto &index : secondaryIndexes) {
+        if (&index->field() == field) {
+            cerr << "Error: " << fieldName << " is already indexed" << endl;
+            return false;
+        }
+    }
+    auto start = high_resolution_clock::now();
+    auto index = make_unique<SecondaryIndex>(*field, bTree.t);
+    index->build(bTree);
+    auto end = high_resolution_clock::now();
+    cout << "Indexed " << index->size() << " records on " << field->name << " in " << fixed << setprecision(3)
+         << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms." << endl;
+    secondaryIndexes.push_back(std::move(index));
+    return true;
 }
 
+// Asks for a field name and returns its index, or nullptr if it has none.
+static SecondaryIndex *chooseSecondaryIndex() {
+    if (secondaryIndexes.empty()) {
+        cout << "No secondary indexes yet; create one first.\n";
+        return nullptr;
+    }
+    string name;
+    cout << "Enter Field: ";
+    cin >> name;
+    for (const auto &index : secondaryIndexes) {
+        if (name == index->field().name)
+            return index.get();
+    }
+    cout << "No index on " << name << ".\n";
+    return nullptr;
+}
+
+// Field values as the record table shows them: counts whole, rates to two
+// decimals.
+static string formatFieldValue(const NumericField &field, double value) {
+    if (field.intValue) return to_string((long long)value);
+    ostringstream out;
+    out << fixed << setprecision(2) << value;
+    return out.str();
+}
+
+// Index entries in the 16-column record table. A menu action writes all its
+// tables through one writer, so --output holds every one of them.
+static void writeIndexedRecords(ReportWriter &writer, const string &title, const vector<const Record *> &records) {
+    writer.text("\n========================================================================================================================\n");
+    writer.text("                                    ");
+    writer.text(title);
+    writer.text("\n========================================================================================================================\n");
+    writeRecordTableHeader(writer);
+    for (const Record *r : records) {
+        if (writer.pageFull()) break;
+        if (writer.beginRow())
+            writeRecordRow(writer, *r);
+    }
+    writer.text("========================================================================================================================\n");
+    writer.flush();
+}
+
+void secondaryIndexMenu(BTree &bTree) {
+    while (true) {
+        cout << "\n--- Secondary Indexes ---\n";
+        cout << "Indexed fields:";
+        if (secondaryIndexes.empty()) cout << " (none)";
+        for (const auto &index : secondaryIndexes)
+            cout << " " << index->field().name;
+        cout << "\n";
+        cout << "[1] Create Index\n";
+        cout << "[2] Range Query\n";
+        cout << "[3] Top/Bottom K\n";
+        cout << "[4] Percentile of a Record\n";
+        cout << "[5] Quantiles\n";
+        cout << "[6] Back\n";
+        cout << "Enter choice: ";
+        int choice;
+        cin >> choice;
+
+        if (choice == 1) {
+            cout << "Numeric fields:";
+            for (const NumericField &field : numericFields())
+                cout << " " << field.name;
+            cout << "\nEnter Field: ";
+            string name;
+            cin >> name;
+            createSecondaryIndex(name, bTree);
+        }
+        else if (choice == 2) {
+            SecondaryIndex *index = chooseSecondaryIndex();
+            if (!index) continue;
+            double lo, hi;
+            string state;
+            cout << "Enter Minimum: "; cin >> lo;
+            cout << "Enter Maximum: "; cin >> hi;
+            cout << "Enter State (* for all): "; cin >> ws; getline(cin, state);
+
+            vector<const Record *> matches;
+            auto start = high_resolution_clock::now();
+            index->range(lo, hi, [&](const Record &r) {
+                if (state == "*" || r.state == state)
+                    matches.push_back(&r);
+            });
+            auto end = high_resolution_clock::now();
+            ostringstream title;
+            title << index->field().name << " in [" << lo << ", " << hi << "]";
+            if (state != "*") title << " for " << state;
+            ReportWriter writer(reportOptions);
+            writeIndexedRecords(writer, title.str(), matches);
+            printPageSummary(writer, matches.size());
+            cout << "Records found: " << matches.size() << "\n";
+            cout << "Index Query Time: " << fixed << setprecision(3)
+                 << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+        }
+        else if (choice == 3) {
+            SecondaryIndex *index = chooseSecondaryIndex();
+            if (!index) continue;
+            size_t k;
+            cout << "Enter K: "; cin >> k;
+
+            auto start = high_resolution_clock::now();
+            vector<const Record *> top = index->largest(k);
+            vector<const Record *> bottom = index->smallest(k);
+            auto end = high_resolution_clock::now();
+            // K already bounds both tables, so like Top/Bottom 5 they are
+            // not paged.
+            ReportWriter writer(reportOptions, false);
+            writeIndexedRecords(writer, "TOP " + to_string(k) + " BY " + index->field().name, top);
+            writeIndexedRecords(writer, "BOTTOM " + to_string(k) + " BY " + index->field().name, bottom);
+            if (writer.toFile())
+                cout << "Report written to " << writer.path() << "\n";
+            cout << "Index Query Time: " << fixed << setprecision(3)
+                 << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+        }
+        else if (choice == 4) {
+            SecondaryIndex *index = chooseSecondaryIndex();
+            if (!index) continue;
+            string state;
+            int year;
+            cout << "Enter State: "; cin >> ws; getline(cin, state);
+            cout << "Enter Year: "; cin >> year;
+            const Record *r = bTree.search(state, year);
+            if (!r) {
+                cout << "Record not found." << endl;
+                continue;
+            }
+
+            double value = index->field().value(*r);
+            auto start = high_resolution_clock::now();
+            size_t below = index->countBelow(value);
+            double percentile = index->percentileRank(value);
+            auto end = high_resolution_clock::now();
+            cout << "\n" << state << " " << year << ": " << index->field().name << " = "
+                 << formatFieldValue(index->field(), value) << "\n";
+            cout << "Percentile rank: " << fixed << setprecision(2) << percentile << " ("
+                 << below << " of " << index->size() << " records are lower)\n";
+            cout << "Index Query Time: " << fixed << setprecision(3)
+                 << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+        }
+        else if (choice == 5) {
+            SecondaryIndex *index = chooseSecondaryIndex();
+            if (!index) continue;
+            static const int percents[] = {0, 10, 25, 50, 75, 90, 100};
+
+            const Record *at[size(percents)];
+            auto start = high_resolution_clock::now();
+            for (size_t i = 0; i < size(percents); ++i)
+                at[i] = index->quantile(percents[i] / 100.0);
+            auto end = high_resolution_clock::now();
+            if (!at[0]) {
+                cout << "No data available.\n";
+                continue;
+            }
+            cout << "\n" << left << setw(14) << "Percentile"
+                 << setw(20) << index->field().name
+                 << "Record" << endl;
+            cout << string(60, '-') << endl;
+            for (size_t i = 0; i < size(percents); ++i) {
+                cout << left << setw(14) << (percents[i] == 50 ? "50 (median)" : to_string(percents[i]))
+                     << setw(20) << formatFieldValue(index->field(), index->field().value(*at[i]))
+                     << at[i]->state << " " << at[i]->year << endl;
+            }
+            cout << "Index Query Time: " << fixed << setprecision(3)
+                 << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+        }
+        else if (choice == 6) {
+            return;
+        }
+        else {
+            cout << "Invalid choice. Please try again.\n";
+        }
+    }
+}
+
+void showRangeAggregates(BTree &bTree) {
+    string state;
+    int fromYear, toYear;
+    cout << "\n--- Range Aggregates ---\n";
+    cout << "Enter State: "; cin >> ws; getline(cin, state);
+    cout << "Enter From Year: "; cin >> fromYear;
+    cout << "Enter To Year: "; cin >> toYear;
+
+    // Keys from State_fromYear up to and including State_toYear.
+    string lo = makeKey(state, fromYear);
+    string hi = makeKey(state, toYear);
+    hi.push_back('\0');
+    auto start = high_resolution_clock::now();
+    vector<Aggregate> totals = bTree.rangeAggregate(lo, hi);
+    auto end = high_resolution_clock::now();
+    if (totals.empty() || totals[0].count == 0) {
+        cout << "No records found for " << state << " " << fromYear << "-" << toYear << ".\n";
+        return;
+    }
+
+    const vector<const NumericField *> &fields = bTree.aggregateFields();
+    cout << "\n" << state << " " << fromYear << "-" << toYear << ": " << totals[0].count << " records\n";
+    cout << left << setw(24) << "Field"
+         << setw(20) << "Sum"
+         << setw(16) << "Min"
+         << setw(16) << "Max"
+         << "Average" << endl;
+    cout << string(88, '-') << endl;
+    for (size_t f = 0; f < fields.size(); ++f) {
+        cout << left << setw(24) << fields[f]->name
+             << setw(20) << formatFieldValue(*fields[f], totals[f].sum)
+             << setw(16) << formatFieldValue(*fields[f], totals[f].min)
+             << setw(16) << formatFieldValue(*fields[f], totals[f].max)
+             << fixed << setprecision(2) << totals[f].mean() << endl;
+    }
+    cout << "Aggregate Query Time: " << fixed << setprecision(3)
+         << duration_cast<microseconds>(end - start).count() / 1000.0 << " ms\n";
+}
@@ -8,7 +8,19 @@
 #include "HashMap.h"
 #include "BTree.h"
 #include "Record.h"
+#include "ReportWriter.h"
+#include "WriteAheadLog.h"
+#include "SecondaryIndex.h"
 #include <string>
+#include <vector>
+
+// Write-ahead logging of menu inserts and deletes (--wal, --wal-batch,
+// --wal-delay, --checkpoint on the command line).
+struct DurabilityOptions {
+    std::string logPath;            // empty disables logging
+    size_t checkpointEvery = 1000;  // logged changes between checkpoints
+    WalOptions wal;
+};
 
 void loadDataFromCSV(const std::string &filename, HashMap &hashTable, BTree &bTree);
 void generateRandomData(HashMap &hashTable, BTree &bTree, int count);
@@ -16,6 +28,30 @@ void mainMenu(HashMap &hashTable, BTree &bTree);
 void comparePerformance(HashMap &hashTable, BTree &bTree);
 void showAllRecordsForState(HashMap &hashTable, BTree &bTree);
 void showTopBottomJobCreation(HashMap &hashTable, BTree &bTree);
-void showDatasetStatistics(HashMap &hashTable, BTree &bTree);
+void showDatasetStatistics(BTree &bTree);
+void showAllRecords(HashMap &hashTable);
+void setReportOptions(const ReportOptions &options);
+// Loads the last checkpoint and replays the log written since. Without a
+// checkpoint (or with logging off) it loads the CSV; with logging on it then
+// writes an initial checkpoint, since the CSV load pads with random records.
+bool openDataStore(const std::string &csvPath, const DurabilityOptions &options, HashMap &hashTable, BTree &bTree);
+// Checkpoints so the next start does not need to replay the log.
+void closeDataStore(BTree &bTree);
+// Menu mutations. With logging on, the change is on disk before it is applied.
+bool insertRecord(HashMap &hashTable, BTree &bTree, const Record &r);
+void deleteRecord(HashMap &hashTable, BTree &bTree, const std::string &state, int year);
+// Writes every record to the snapshot next to the log, then empties the log.
+bool checkpoint(BTree &bTree);
+// Builds a secondary index on a numeric Record field (--index on the command
+// line, or the Secondary Indexes menu). Menu inserts and deletes keep every
+// index up to date. Returns false for an unknown or already indexed field.
+bool createSecondaryIndex(const std::string &fieldName, BTree &bTree);
+void secondaryIndexMenu(BTree &bTree);
+// Keeps subtree aggregates in bTree for the fields Dataset Statistics reads
+// plus extraFields (--aggregate on the command line).
+void trackAggregateFields(const std::vector<std::string> &extraFields, BTree &bTree);
+// Count, sum, min, max and average of every aggregated field over one
+// state's records in a year range, from the BTree's subtree aggregates.
+void showRangeAggregates(BTree &bTree);
 
 #endif